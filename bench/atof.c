@@ -0,0 +1,184 @@
+/*
+ * Checks that nanosvg's number parser gives the same result, to the bit,
+ * as the strtoll() and pow() based parser it replaced, which nanosvg keeps
+ * as nsvg__atofSlow() for the numbers it can't take the fast path for.
+ * Some edge cases and every number in the files given are checked, as
+ * well as those in the logos and the font if there are any, and both
+ * parsers are timed on them.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Build the implementation here too, for its static number parsers */
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+
+#define NUMBER_LEN 64
+#define ROUNDS 20
+
+static const char *edge_cases[] = {
+	"0", "-0", "+0", ".5", "-.5", "5.", "-", "+", ".", "", "e5", "1e",
+	"1e5", "1E-5", "-2.5e+3", "1.5e", "007", "0.000001", "123456789012345678",
+	"1234567890123456789", "12345678901234567890123", "0.123456789012345678",
+	"0.1234567890123456789", "0.00000000000000000000001",
+	"9223372036854775807", "9223372036854775808", "3.4028235e38",
+	"1.17549435e-38", "999999999999999999.999999999999999999",
+};
+
+static char (*numbers)[NUMBER_LEN];
+static int n_numbers, cap_numbers;
+
+static void add_number(const char *s)
+{
+	if (n_numbers == cap_numbers) {
+		cap_numbers = cap_numbers ? cap_numbers * 2 : 4096;
+		numbers = realloc(numbers, cap_numbers * sizeof(*numbers));
+	}
+	snprintf(numbers[n_numbers++], NUMBER_LEN, "%s", s);
+}
+
+static bool starts_number(const char *s)
+{
+	if (*s == '-' || *s == '+')
+		s++;
+	if (*s == '.')
+		s++;
+	return nsvg__isdigit(*s);
+}
+
+/* Add every number in the file at path, the way the parser splits them */
+static bool add_numbers_in(const char *path)
+{
+	char buf[NUMBER_LEN];
+	const char *s;
+	char *data;
+	long size;
+	bool ok = false;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data = malloc(size + 1);
+	if (data && fread(data, 1, size, fp) == (size_t)size) {
+		data[size] = '\0';
+		for (s = data; *s;) {
+			if (starts_number(s)) {
+				s = nsvg__parseNumber(s, buf, NUMBER_LEN);
+				add_number(buf);
+			} else {
+				s++;
+			}
+		}
+		ok = true;
+	}
+	free(data);
+	fclose(fp);
+	return ok;
+}
+
+static int is_svg(const struct dirent *d)
+{
+	size_t len = strlen(d->d_name);
+
+	return len > 4 && !strcmp(d->d_name + len - 4, ".svg");
+}
+
+static void add_numbers_in_dir(const char *dir)
+{
+	struct dirent **list;
+	char path[4096];
+	int n = scandir(dir, &list, is_svg, alphasort);
+
+	for (int i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, list[i]->d_name);
+		add_numbers_in(path);
+		free(list[i]);
+	}
+	if (n > 0)
+		free(list);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double time_parser(double (*parse)(const char *))
+{
+	volatile double sink = 0;
+	double start = now_us();
+
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < n_numbers; i++)
+			sink += parse(numbers[i]);
+	}
+	(void)sink;
+	return (now_us() - start) / ROUNDS;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "pbsplash-bench-atof [-l logo dir] [-f font] [file...]\n");
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	int optflag, from_assets, from_files, mismatches = 0;
+
+	while ((optflag = getopt(argc, argv, "l:f:")) != -1) {
+		switch (optflag) {
+		case 'l':
+			add_numbers_in_dir(optarg);
+			break;
+		case 'f':
+			add_numbers_in(optarg);
+			break;
+		default:
+			return usage();
+		}
+	}
+
+	/* The logos and font are optional, the files given are not */
+	from_assets = n_numbers;
+	for (int i = optind; i < argc; i++) {
+		if (!add_numbers_in(argv[i])) {
+			fprintf(stderr, "failed to read %s\n", argv[i]);
+			return 1;
+		}
+	}
+	from_files = n_numbers - from_assets;
+	for (size_t i = 0; i < sizeof(edge_cases) / sizeof(*edge_cases); i++)
+		add_number(edge_cases[i]);
+
+	for (int i = 0; i < n_numbers; i++) {
+		double fast = nsvg__atof(numbers[i]);
+		double slow = nsvg__atofSlow(numbers[i]);
+
+		if (memcmp(&fast, &slow, sizeof(fast))) {
+			if (mismatches++ < 10)
+				fprintf(stderr, "mismatch for \"%s\": %.17g != %.17g\n",
+					numbers[i], fast, slow);
+		}
+	}
+
+	printf("atof: %d numbers (%d from assets, %d from files), %d mismatches\n",
+	       n_numbers, from_assets, from_files, mismatches);
+	printf("%-36s %10.1f us per pass\n", "atof/slow", time_parser(nsvg__atofSlow));
+	printf("%-36s %10.1f us per pass\n", "atof/fast", time_parser(nsvg__atof));
+
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,566 @@
+/*
+ * Benchmarks for the stages of drawing a splash: SVG parsing, logo
+ * rasterization, text layout and rendering, blitting and the animation.
+ * Everything renders into a headless framebuffer so this runs without a
+ * display. Each benchmark reports the median and 99th percentile latency.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nanosvg.h"
+#include "nanosvgrast.h"
+#include "fb.h"
+#include "pbsplash.h"
+#include "svgbin.h"
+#include "text.h"
+
+/* Exit code meson treats as a skipped test */
+#define EXIT_SKIP 77
+
+#define MAX_LOGOS 64
+
+bool debug = false;
+
+static const char *font_path;
+static char *logos[MAX_LOGOS];
+static int n_logos;
+/* Overrides the per benchmark default number of iterations if set */
+static int iterations;
+
+static const struct {
+	const char *name;
+	int width, height;
+} screens[] = {
+	{ "1080p", 1080, 1920 },
+	{ "1440p", 1440, 2560 },
+	{ "4k", 2160, 3840 },
+};
+
+static const struct col background = { .r = 0, .g = 0, .b = 0, .a = 255 };
+
+static const char *short_message = "Booting postmarketOS";
+static const char *long_message =
+	"Your device is being updated, please do not turn it off. This may "
+	"take a while depending on the size of the update and the speed of "
+	"the storage. The device will reboot automatically once the update "
+	"has been installed, after which you will be asked for your disk "
+	"encryption passphrase as usual.";
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench(const char *name, int n, void (*fn)(void *), void *arg)
+{
+	double *samples;
+
+	if (iterations)
+		n = iterations;
+	samples = calloc(n, sizeof(*samples));
+	if (!samples) {
+		fprintf(stderr, "%s: out of memory for %d samples\n", name, n);
+		return;
+	}
+
+	// Warm up caches and anything lazily initialised
+	fn(arg);
+
+	for (int i = 0; i < n; i++) {
+		double start = now_us();
+		fn(arg);
+		samples[i] = now_us() - start;
+	}
+
+	qsort(samples, n, sizeof(*samples), cmp_double);
+	printf("%-36s median %10.1f us  p99 %10.1f us  (n=%d)\n", name,
+	       samples[n / 2], samples[(int)ceil(n * 0.99) - 1], n);
+	free(samples);
+}
+
+static const char *basename_of(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	return slash ? slash + 1 : path;
+}
+
+static int is_svg(const struct dirent *d)
+{
+	size_t len = strlen(d->d_name);
+
+	return len > 4 && !strcmp(d->d_name + len - 4, ".svg");
+}
+
+/* Collect the SVG logos in dir, skipping the font if it lives there too */
+static void load_corpus(const char *dir)
+{
+	struct dirent **list;
+	int n = scandir(dir, &list, is_svg, alphasort);
+
+	for (int i = 0; i < n; i++) {
+		char *path = malloc(strlen(dir) + strlen(list[i]->d_name) + 2);
+
+		sprintf(path, "%s/%s", dir, list[i]->d_name);
+		if (n_logos < MAX_LOGOS && access(path, R_OK) == 0 &&
+		    (!font_path || strcmp(basename_of(path),
+					  basename_of(font_path))))
+			logos[n_logos++] = path;
+		else
+			free(path);
+		free(list[i]);
+	}
+	if (n > 0)
+		free(list);
+}
+
+static bool have_font(void)
+{
+	return font_path && access(font_path, R_OK) == 0;
+}
+
+/* Logo size on a screen, the same way pbsplash picks it without a DPI cap */
+static float logo_size(int width, int height)
+{
+	return (width < height ? width : height) * 0.75f;
+}
+
+/* Font scale for a message at the default 9pt on a ~400 dpi phone */
+static float font_scale(const NSVGimage *font, int width)
+{
+	float pixels_per_milli = width / 68.f;
+
+	return (9 * 0.38f) / (font->fontAscent - font->fontDescent) *
+	       pixels_per_milli;
+}
+
+struct parse_arg {
+	const char *path;
+	const char *units;
+	float dpi;
+};
+
+static void run_parse(void *data)
+{
+	struct parse_arg *arg = data;
+
+	nsvgDelete(nsvgParseFromFile(arg->path, arg->units, arg->dpi));
+}
+
+static void run_parse_chunked(void *data)
+{
+	struct parse_arg *arg = data;
+
+	nsvgDelete(nsvgParseFromFileChunked(arg->path, arg->units, arg->dpi, 0));
+}
+
+static void run_load_compiled(void *data)
+{
+	struct parse_arg *arg = data;
+
+	nsvgDelete(svgbin_load(arg->path, arg->units, arg->dpi, NULL));
+}
+
+/* Time parsing arg->path, whole and in chunks, and loading it compiled */
+static void bench_parse(const struct parse_arg *arg, int iters)
+{
+	char name[128], compiled[] = "/tmp/pbsplash-bench-XXXXXX";
+	struct parse_arg carg = *arg;
+	NSVGimage *image;
+	int fd;
+
+	snprintf(name, sizeof(name), "parse/%s", basename_of(arg->path));
+	bench(name, iters, run_parse, &carg);
+	snprintf(name, sizeof(name), "parse/%s-chunked", basename_of(arg->path));
+	bench(name, iters, run_parse_chunked, &carg);
+
+	fd = mkstemp(compiled);
+	if (fd < 0)
+		return;
+	close(fd);
+	image = nsvgParseFromFile(arg->path, arg->units, arg->dpi);
+	if (image && svgbin_write(image, compiled) == 0) {
+		carg.path = compiled;
+		snprintf(name, sizeof(name), "parse/%s-compiled",
+			 basename_of(arg->path));
+		bench(name, iters, run_load_compiled, &carg);
+	}
+	nsvgDelete(image);
+	unlink(compiled);
+}
+
+static int stage_parse(void)
+{
+	if (!n_logos && !have_font())
+		return EXIT_SKIP;
+
+	for (int i = 0; i < n_logos; i++) {
+		struct parse_arg arg = { logos[i], "", logo_size(1080, 1920) };
+		bench_parse(&arg, 50);
+	}
+
+	if (have_font()) {
+		struct parse_arg arg = { font_path, "px", 512 };
+		bench_parse(&arg, 20);
+	}
+
+	return 0;
+}
+
+struct raster_arg {
+	NSVGrasterizer *rast;
+	NSVGimage *image;
+	unsigned char *buf;
+	int width, height;
+	float scale;
+};
+
+static void run_rasterize(void *data)
+{
+	struct raster_arg *arg = data;
+
+	memset(arg->buf, 0, arg->width * arg->height * 4);
+	nsvgRasterize(arg->rast, arg->image, 0, 0, arg->scale, arg->buf,
+		      arg->width, arg->height, arg->width * 4);
+}
+
+static int stage_rasterize(void)
+{
+	char name[128];
+
+	if (!n_logos)
+		return EXIT_SKIP;
+
+	for (int i = 0; i < n_logos; i++) {
+		for (size_t s = 0; s < sizeof(screens) / sizeof(*screens); s++) {
+			float size = logo_size(screens[s].width, screens[s].height);
+			struct raster_arg arg;
+
+			arg.image = nsvgParseFromFile(logos[i], "", size);
+			if (!arg.image || arg.image->width <= 0 ||
+			    arg.image->height <= 0) {
+				nsvgDelete(arg.image);
+				break;
+			}
+
+			arg.scale = size / (arg.image->width > arg.image->height ?
+						    arg.image->height :
+						    arg.image->width);
+			arg.width = arg.image->width * arg.scale + 0.5f;
+			arg.height = arg.image->height * arg.scale + 0.5f;
+			arg.buf = malloc(arg.width * arg.height * 4);
+			arg.rast = nsvgCreateRasterizer();
+
+			snprintf(name, sizeof(name), "rasterize/%s@%s",
+				 basename_of(logos[i]), screens[s].name);
+			bench(name, 20, run_rasterize, &arg);
+			snprintf(name, sizeof(name), "rasterize/%s@%s-analytic",
+				 basename_of(logos[i]), screens[s].name);
+			nsvgRasterizerSetFlags(arg.rast, NSVG_RAST_ANALYTIC);
+			bench(name, 20, run_rasterize, &arg);
+
+			nsvgDeleteRasterizer(arg.rast);
+			free(arg.buf);
+			nsvgDelete(arg.image);
+		}
+	}
+
+	return 0;
+}
+
+struct text_arg {
+	NSVGrasterizer *rast;
+	NSVGimage *font;
+	const char *text;
+	unsigned char *buf;
+	int width, height;
+	float scale;
+};
+
+static void run_layout(void *data)
+{
+	struct text_arg *arg = data;
+	int width, height;
+	const char *out = getTextDimensions(arg->font, arg->text, arg->scale,
+					    1080 * 0.95, &width, &height);
+
+	if (out != arg->text)
+		free((void *)out);
+}
+
+static void run_text(void *data)
+{
+	struct text_arg *arg = data;
+
+	memset(arg->buf, 0, arg->width * arg->height * 4);
+	nsvgRasterizeText(arg->rast, arg->font, 0, 0, arg->scale, arg->buf,
+			  arg->width, arg->height, arg->width * 4, arg->text);
+}
+
+static void run_text_mask(void *data)
+{
+	struct text_arg *arg = data;
+
+	memset(arg->buf, 0, arg->width * arg->height);
+	nsvgRasterizeTextMask(arg->rast, arg->font, 0, 0, arg->scale,
+			      arg->buf, arg->width, arg->height, arg->width,
+			      arg->text);
+}
+
+/* data is the set of characters to parse glyphs for, NULL for all */
+static void run_parse_font(void *data)
+{
+	const char *chars = data;
+
+	if (chars)
+		nsvgDelete(nsvgParseFontFromFile(font_path, "px", 512, chars));
+	else
+		nsvgDelete(nsvgParseFromFile(font_path, "px", 512));
+}
+
+static int stage_text(void)
+{
+	const char *messages[][2] = {
+		{ "short", short_message },
+		{ "long", long_message },
+	};
+	struct text_arg arg;
+	char name[128];
+
+	if (!have_font())
+		return EXIT_SKIP;
+
+	arg.font = nsvgParseFromFile(font_path, "px", 512);
+	if (!arg.font || !arg.font->shapes)
+		return EXIT_SKIP;
+	arg.scale = font_scale(arg.font, 1080);
+	arg.rast = nsvgCreateRasterizer();
+
+	bench("text/parse-font", 20, run_parse_font, NULL);
+	bench("text/parse-font-subset", 20, run_parse_font,
+	      (void *)long_message);
+
+	for (size_t i = 0; i < sizeof(messages) / sizeof(*messages); i++) {
+		const char *laid_out;
+
+		arg.text = messages[i][1];
+		snprintf(name, sizeof(name), "text/layout-%s", messages[i][0]);
+		bench(name, 200, run_layout, &arg);
+
+		laid_out = getTextDimensions(arg.font, messages[i][1], arg.scale,
+					     1080 * 0.95, &arg.width,
+					     &arg.height);
+		arg.text = laid_out;
+		arg.buf = malloc(arg.width * arg.height * 4);
+		snprintf(name, sizeof(name), "text/rasterize-%s",
+			 messages[i][0]);
+		nsvgRasterizerSetFlags(arg.rast, 0);
+		bench(name, 100, run_text, &arg);
+		snprintf(name, sizeof(name), "text/rasterize-%s-single-pass",
+			 messages[i][0]);
+		nsvgRasterizerSetFlags(arg.rast, NSVG_RAST_TEXT_SINGLE_PASS);
+		bench(name, 100, run_text, &arg);
+		snprintf(name, sizeof(name), "text/rasterize-%s-mask",
+			 messages[i][0]);
+		nsvgRasterizerSetFlags(arg.rast, 0);
+		bench(name, 100, run_text_mask, &arg);
+		snprintf(name, sizeof(name), "text/rasterize-%s-mask-analytic",
+			 messages[i][0]);
+		nsvgRasterizerSetFlags(arg.rast, NSVG_RAST_ANALYTIC);
+		bench(name, 100, run_text_mask, &arg);
+		snprintf(name, sizeof(name), "text/rasterize-%s-mask-cached",
+			 messages[i][0]);
+		nsvgRasterizerSetFlags(arg.rast, NSVG_RAST_TEXT_GLYPH_CACHE);
+		bench(name, 100, run_text_mask, &arg);
+		nsvgRasterizerClearGlyphCache(arg.rast);
+		free(arg.buf);
+		if (laid_out != messages[i][1])
+			free((void *)laid_out);
+	}
+
+	nsvgDeleteRasterizer(arg.rast);
+	nsvgDelete(arg.font);
+	return 0;
+}
+
+struct blit_arg {
+	unsigned char *buf;
+	unsigned char *mask;
+	int size;
+};
+
+static void run_blit(void *data)
+{
+	struct blit_arg *arg = data;
+
+	fb_blit(arg->buf, (fb_width() - arg->size) / 2,
+		(fb_height() - arg->size) / 2, arg->size, arg->size, false,
+		background);
+}
+
+static void run_blit_mask(void *data)
+{
+	struct blit_arg *arg = data;
+	struct col white = { .r = 255, .g = 255, .b = 255, .a = 255 };
+
+	fb_blit_mask(arg->mask, (fb_width() - arg->size) / 2,
+		     (fb_height() - arg->size) / 2, arg->size, arg->size,
+		     false, white, background);
+}
+
+/*
+ * A synthetic logo, so blitting doesn't depend on the corpus: an opaque
+ * disc with an anti-aliased edge and a translucent ring around it on a
+ * transparent background.
+ */
+static unsigned char *make_logo(int size)
+{
+	unsigned char *buf = calloc(size * size, 4);
+	float r = size * 0.4f;
+
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			struct col *c = (struct col *)buf + y * size + x;
+			float d = hypotf(x - size / 2.f, y - size / 2.f);
+			float cov = fminf(fmaxf(r - d + 0.5f, 0.f), 1.f);
+
+			c->r = x * 255 / size;
+			c->g = y * 255 / size;
+			c->b = 128;
+			if (d > r + 2 && d < size * 0.48f)
+				c->a = 96;
+			else
+				c->a = cov * 255;
+		}
+	}
+
+	return buf;
+}
+
+static int stage_blit(void)
+{
+	struct fb_headless_config cfg = { 1080, 1920, 68, 121 };
+	struct blit_arg arg = { .size = logo_size(1080, 1920) };
+	char name[128];
+
+	arg.buf = make_logo(arg.size);
+	// The same shape as a coverage mask, as text is drawn
+	arg.mask = malloc(arg.size * arg.size);
+	for (int i = 0; i < arg.size * arg.size; i++)
+		arg.mask[i] = ((struct col *)arg.buf)[i].a;
+	for (int f = FB_FORMAT_XRGB8888; f <= FB_FORMAT_BGR565; f++) {
+		cfg.format = f;
+		if (fb_acquire_headless(&cfg))
+			return 1;
+		snprintf(name, sizeof(name), "blit/%s", blit_format_name(f));
+		bench(name, 200, run_blit, &arg);
+		snprintf(name, sizeof(name), "blit/%s-mask",
+			 blit_format_name(f));
+		bench(name, 200, run_blit_mask, &arg);
+		fb_release();
+	}
+	free(arg.mask);
+	free(arg.buf);
+
+	return 0;
+}
+
+static void run_animate(void *data)
+{
+	int *frame = data;
+
+	animate_frame((*frame)++, fb_width(), fb_height() * 0.7f, 400);
+}
+
+static int stage_animate(void)
+{
+	struct fb_headless_config cfg = { 1080, 1920, 68, 121,
+					  FB_FORMAT_XRGB8888 };
+	int frame = 0;
+
+	if (fb_acquire_headless(&cfg))
+		return 1;
+	bench("animate/frame", 1000, run_animate, &frame);
+	fb_release();
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(void);
+} stages[] = {
+	{ "parse", stage_parse },	  { "rasterize", stage_rasterize },
+	{ "text", stage_text },		  { "blit", stage_blit },
+	{ "animate", stage_animate },
+};
+
+static int usage(void)
+{
+	fprintf(stderr, "pbsplash-bench [-l logo dir] [-f font] [-n iterations] "
+			"stage\n\nstages:");
+	for (size_t i = 0; i < sizeof(stages) / sizeof(*stages); i++)
+		fprintf(stderr, " %s", stages[i].name);
+	fprintf(stderr, "\n");
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *logo_dir = NULL;
+	int optflag;
+	long n;
+	char *end;
+
+	while ((optflag = getopt(argc, argv, "l:f:n:")) != -1) {
+		switch (optflag) {
+		case 'l':
+			logo_dir = optarg;
+			break;
+		case 'f':
+			font_path = optarg;
+			break;
+		case 'n':
+			n = strtol(optarg, &end, 10);
+			if (end == optarg || *end || n <= 0 || n > INT_MAX) {
+				fprintf(stderr, "Invalid iterations: %s\n", optarg);
+				return usage();
+			}
+			iterations = n;
+			break;
+		default:
+			return usage();
+		}
+	}
+
+	if (optind != argc - 1)
+		return usage();
+
+	if (logo_dir)
+		load_corpus(logo_dir);
+
+	for (size_t i = 0; i < sizeof(stages) / sizeof(*stages); i++) {
+		if (!strcmp(argv[optind], stages[i].name))
+			return stages[i].run();
+	}
+
+	return usage();
+}
@@ -0,0 +1,186 @@
+/*
+ * Checks that each of the rasterizer's vector compositing kernels built
+ * for this machine gives the same bytes as the scalar one, on random
+ * spans of every length up to a few vectors, with solid and per-pixel
+ * colours. Then times them on rows the width of a 1080p portrait screen,
+ * with coverage like the inside and the edges of a logo.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Build the implementation here too, for its static kernels */
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+#define NANOSVGRAST_IMPLEMENTATION
+#include "nanosvgrast.h"
+
+#define WIDTH 1080
+#define ROUNDS 2000
+#define CHECK_ROUNDS 200
+#define CHECK_MAX_COUNT 40
+
+struct kernel {
+	const char *name;
+	NSVGblendSpanFunc blend;
+	bool available;
+};
+
+static struct kernel kernels[] = {
+	{ "scalar", nsvg__blendSpan, true },
+#ifdef NSVG__BLEND_SSE2
+	{ "sse2", nsvg__blendSpanSSE2, true },
+#endif
+#ifdef NSVG__BLEND_AVX2
+	{ "avx2", nsvg__blendSpanAVX2, false },
+#endif
+#ifdef NSVG__BLEND_NEON
+	{ "neon", nsvg__blendSpanNEON, true },
+#endif
+};
+
+#define N_KERNELS (int)(sizeof(kernels) / sizeof(*kernels))
+
+/* Random bytes, biased to the values the kernels take shortcuts for */
+static unsigned char random_byte(void)
+{
+	switch (rand() % 4) {
+	case 0:
+		return 0;
+	case 1:
+		return 255;
+	default:
+		return rand();
+	}
+}
+
+static void fill_random(unsigned char *buf, int n)
+{
+	for (int i = 0; i < n; i++)
+		buf[i] = random_byte();
+}
+
+/* Fills whole groups of cover with one value, to hit the group shortcuts */
+static void fill_cover(unsigned char *cover, int n)
+{
+	for (int i = 0; i < n; i += 8) {
+		unsigned char v = random_byte();
+
+		for (int j = i; j < i + 8 && j < n; j++)
+			cover[j] = rand() % 8 ? v : random_byte();
+	}
+}
+
+static int check(const struct kernel *k)
+{
+	unsigned char cover[CHECK_MAX_COUNT], want[CHECK_MAX_COUNT * 4],
+		got[CHECK_MAX_COUNT * 4];
+	unsigned int colors[CHECK_MAX_COUNT];
+	int mismatches = 0;
+
+	for (int r = 0; r < CHECK_ROUNDS; r++) {
+		for (int count = 0; count < CHECK_MAX_COUNT; count++) {
+			for (int solid = 0; solid < 2; solid++) {
+				fill_cover(cover, count);
+				fill_random((unsigned char *)colors, sizeof(colors));
+				if (solid && rand() % 2)
+					colors[0] |= 0xff000000u;
+				fill_random(want, count * 4);
+				memcpy(got, want, count * 4);
+
+				nsvg__blendSpan(want, count, cover, colors, solid);
+				k->blend(got, count, cover, colors, solid);
+				if (memcmp(want, got, count * 4))
+					mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* A solid interior with antialiased ends, or a row of thin coverage */
+static void make_row(unsigned char *cover, bool interior)
+{
+	for (int i = 0; i < WIDTH; i++)
+		cover[i] = interior ? 255 : (i % 7 ? 0 : 40 + i % 200);
+	if (interior) {
+		cover[0] = 60;
+		cover[WIDTH - 1] = 190;
+	}
+}
+
+static double time_kernel(const struct kernel *k, const unsigned char *cover,
+			  const unsigned int *colors, int solid)
+{
+	static unsigned char dst[WIDTH * 4];
+	double start;
+
+	memset(dst, 0x40, sizeof(dst));
+	start = now_us();
+	for (int r = 0; r < ROUNDS; r++)
+		k->blend(dst, WIDTH, cover, colors, solid);
+	return (now_us() - start) / ROUNDS;
+}
+
+int main(void)
+{
+	static const struct {
+		const char *name;
+		bool interior;
+		int solid;
+		unsigned int alpha;
+	} cases[] = {
+		{ "solid-opaque", true, 1, 0xff },
+		{ "solid-translucent", true, 1, 0x80 },
+		{ "solid-edges", false, 1, 0xff },
+		{ "gradient", true, 0, 0xff },
+	};
+	unsigned char cover[WIDTH];
+	unsigned int colors[WIDTH];
+	char name[64];
+	int mismatches = 0;
+
+#ifdef NSVG__BLEND_AVX2
+	kernels[N_KERNELS - 1].available = __builtin_cpu_supports("avx2");
+#endif
+
+	srand(1);
+	for (int i = 1; i < N_KERNELS; i++) {
+		int m;
+
+		if (!kernels[i].available)
+			continue;
+		m = check(&kernels[i]);
+		printf("blend/%s: %d mismatches\n", kernels[i].name, m);
+		mismatches += m;
+	}
+
+	for (size_t c = 0; c < sizeof(cases) / sizeof(*cases); c++) {
+		make_row(cover, cases[c].interior);
+		for (int i = 0; i < WIDTH; i++)
+			colors[i] = (cases[c].alpha << 24) |
+				    (cases[c].solid ? 0x3366cc : 0x010203u * (i & 0xff));
+		for (int i = 0; i < N_KERNELS; i++) {
+			if (!kernels[i].available)
+				continue;
+			snprintf(name, sizeof(name), "blend/%s/%s", cases[c].name,
+				 kernels[i].name);
+			printf("%-36s %10.2f us per row\n", name,
+			       time_kernel(&kernels[i], cover, colors,
+					   cases[c].solid));
+		}
+	}
+
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * Compares the rasterizer's edge sort with the qsort() call it replaced,
+ * on built in edge sets and, if given, the edges of every shape in the
+ * logos and every glyph in the font, flattened at the sizes pbsplash draws
+ * them. Each sort must give the same order as a stable sort by y0, which
+ * is what qsort() happened to give with glibc's merge sort and what the
+ * rasterizer's output depends on.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Build the implementation here too, for its static edge functions */
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+#define NANOSVGRAST_IMPLEMENTATION
+#include "nanosvgrast.h"
+
+#define ROUNDS 50
+#define BUILTIN_PATH_LEN 8192
+
+struct edge_set {
+	NSVGedge *edges;
+	int n;
+};
+
+struct corpus {
+	const char *name;
+	struct edge_set *sets;
+	int n_sets, cap_sets;
+	long n_edges;
+};
+
+static struct corpus builtin = { .name = "builtin" };
+static struct corpus logos = { .name = "logos" };
+static struct corpus glyphs = { .name = "glyphs" };
+
+/* Keep a copy of the n edges in edges, if there are any */
+static void add_set(struct corpus *c, const NSVGedge *edges, int n)
+{
+	struct edge_set *set;
+
+	if (!n)
+		return;
+	if (c->n_sets == c->cap_sets) {
+		c->cap_sets = c->cap_sets ? c->cap_sets * 2 : 256;
+		c->sets = realloc(c->sets, c->cap_sets * sizeof(*c->sets));
+	}
+	set = &c->sets[c->n_sets++];
+	set->n = n;
+	set->edges = malloc(n * sizeof(NSVGedge));
+	memcpy(set->edges, edges, n * sizeof(NSVGedge));
+	c->n_edges += n;
+}
+
+/* Add the fill and stroke edges of every shape in image at scale */
+static void add_image(struct corpus *c, NSVGrasterizer *rast,
+		      NSVGimage *image, float scale)
+{
+	for (NSVGshape *shape = image->shapes; shape; shape = shape->next) {
+		if (!shape->paths)
+			continue;
+		if (shape->fill.type != NSVG_PAINT_NONE) {
+			rast->nedges = 0;
+			nsvg__flattenShape(rast, shape, scale);
+			add_set(c, rast->edges, rast->nedges);
+		}
+		if (shape->stroke.type != NSVG_PAINT_NONE &&
+		    shape->strokeWidth * scale > 0.01f) {
+			rast->nedges = 0;
+			nsvg__flattenShapeStroke(rast, shape, scale);
+			add_set(c, rast->edges, rast->nedges);
+		}
+	}
+}
+
+/*
+ * A row of squares of different heights, all starting on one y, then the
+ * same again above the origin, so most edges tie with many others. Filled
+ * and stroked, at a few scales.
+ */
+static void add_builtin_image(NSVGrasterizer *rast)
+{
+	static const float scales[] = { 0.1f, 1.0f, 3.5f };
+	char svg[BUILTIN_PATH_LEN + 256];
+	int len = 0;
+
+	len += snprintf(svg + len, sizeof(svg) - len,
+			"<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"400\" "
+			"height=\"100\"><path stroke=\"#000\" d=\"");
+	for (int i = 0; i < 60; i++)
+		len += snprintf(svg + len, sizeof(svg) - len,
+				"M%d 10h4v%dh-4z M%d -7.25h4v%dh-4z ", i * 6,
+				1 + i % 7, i * 6, 3 + i % 5);
+	snprintf(svg + len, sizeof(svg) - len, "\"/></svg>");
+
+	for (size_t i = 0; i < sizeof(scales) / sizeof(*scales); i++) {
+		char copy[sizeof(svg)];
+		NSVGimage *image;
+
+		/* nsvgParse() writes into its input */
+		memcpy(copy, svg, sizeof(svg));
+		image = nsvgParse(copy, "px", 96);
+		if (image)
+			add_image(&builtin, rast, image, scales[i]);
+		nsvgDelete(image);
+	}
+}
+
+/*
+ * Edges with y0 drawn from a few values, including negative ones, -0
+ * next to 0 and denormals, which all have to sort as floats compare.
+ * Each edge's x0 is its index, so any change in the order of ties shows.
+ */
+static void add_builtin_random(void)
+{
+	static const float ys[] = {
+		-0.0f, 0.0f, -1.0f, 1.0f, -0.5f, 0.5f, -1e-45f, 1e-45f,
+		-1e30f, 1e30f, -1080.25f, 1080.25f, 255.75f, 256.0f,
+	};
+	static const int sizes[] = {
+		NSVG__RADIX_SORT_MIN - 1, NSVG__RADIX_SORT_MIN, 257, 4096,
+	};
+	NSVGedge *edges = malloc(4096 * sizeof(*edges));
+
+	srand(1);
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+		for (int i = 0; i < sizes[s]; i++) {
+			edges[i].x0 = i;
+			edges[i].y0 = ys[rand() % (sizeof(ys) / sizeof(*ys))];
+			edges[i].x1 = i;
+			edges[i].y1 = edges[i].y0 + 1;
+			edges[i].dir = i % 2 ? 1 : -1;
+		}
+		add_set(&builtin, edges, sizes[s]);
+	}
+	free(edges);
+}
+
+static int is_svg(const struct dirent *d)
+{
+	size_t len = strlen(d->d_name);
+
+	return len > 4 && !strcmp(d->d_name + len - 4, ".svg");
+}
+
+/* Logos as drawn on a 1080p portrait screen, like pbsplash-bench */
+static void add_logos_in_dir(NSVGrasterizer *rast, const char *dir)
+{
+	const float size = 1080 * 0.75f;
+	struct dirent **list;
+	char path[4096];
+	int n = scandir(dir, &list, is_svg, alphasort);
+
+	for (int i = 0; i < n; i++) {
+		NSVGimage *image;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, list[i]->d_name);
+		image = nsvgParseFromFile(path, "", size);
+		if (image && image->width > 0 && image->height > 0)
+			add_image(&logos, rast, image,
+				  size / (image->width > image->height ?
+						  image->height : image->width));
+		nsvgDelete(image);
+		free(list[i]);
+	}
+	if (n > 0)
+		free(list);
+}
+
+/* Glyphs at the default 9pt on a ~400 dpi phone, like pbsplash-bench */
+static void add_font(NSVGrasterizer *rast, const char *path)
+{
+	NSVGimage *font = nsvgParseFromFile(path, "px", 512);
+
+	if (font && font->fontAscent - font->fontDescent > 0)
+		add_image(&glyphs, rast, font,
+			  (9 * 0.38f) / (font->fontAscent - font->fontDescent) *
+				  (1080 / 68.f));
+	nsvgDelete(font);
+}
+
+static int cmp_edge(const void *p, const void *q)
+{
+	const NSVGedge *a = p;
+	const NSVGedge *b = q;
+
+	if (a->y0 < b->y0)
+		return -1;
+	if (a->y0 > b->y0)
+		return 1;
+	return 0;
+}
+
+/* Compares pointers to edges, ordering ties by where the edges are */
+static int cmp_edge_stable(const void *p, const void *q)
+{
+	const NSVGedge *a = *(const NSVGedge *const *)p;
+	const NSVGedge *b = *(const NSVGedge *const *)q;
+	int c = cmp_edge(a, b);
+
+	if (c)
+		return c;
+	return a < b ? -1 : a > b;
+}
+
+static void sort_qsort(NSVGrasterizer *rast)
+{
+	qsort(rast->edges, rast->nedges, sizeof(NSVGedge), cmp_edge);
+}
+
+/* A stable sort, by sorting pointers that keep where each edge was */
+static void sort_reference(NSVGrasterizer *rast)
+{
+	const NSVGedge **order = malloc(rast->nedges * sizeof(*order));
+	NSVGedge *copy = malloc(rast->nedges * sizeof(*copy));
+
+	for (int i = 0; i < rast->nedges; i++)
+		order[i] = &rast->edges[i];
+	qsort(order, rast->nedges, sizeof(*order), cmp_edge_stable);
+	for (int i = 0; i < rast->nedges; i++)
+		copy[i] = *order[i];
+	memcpy(rast->edges, copy, rast->nedges * sizeof(*copy));
+	free(copy);
+	free(order);
+}
+
+/* Copy set into the rasterizer's edges, as flattening would leave them */
+static void load_set(NSVGrasterizer *rast, const struct edge_set *set)
+{
+	if (set->n > rast->cedges) {
+		rast->cedges = set->n;
+		rast->edges = realloc(rast->edges, set->n * sizeof(NSVGedge));
+	}
+	memcpy(rast->edges, set->edges, set->n * sizeof(NSVGedge));
+	rast->nedges = set->n;
+}
+
+static bool same_edge(const NSVGedge *a, const NSVGedge *b)
+{
+	return a->x0 == b->x0 && a->y0 == b->y0 && a->x1 == b->x1 &&
+	       a->y1 == b->y1 && a->dir == b->dir;
+}
+
+static int check(NSVGrasterizer *rast, const struct corpus *c)
+{
+	NSVGedge *want = NULL;
+	int mismatches = 0;
+
+	for (int i = 0; i < c->n_sets; i++) {
+		const struct edge_set *set = &c->sets[i];
+
+		load_set(rast, set);
+		sort_reference(rast);
+		want = realloc(want, set->n * sizeof(NSVGedge));
+		memcpy(want, rast->edges, set->n * sizeof(NSVGedge));
+
+		load_set(rast, set);
+		nsvg__sortEdges(rast);
+		for (int j = 0; j < set->n; j++) {
+			if (!same_edge(&want[j], &rast->edges[j])) {
+				mismatches++;
+				break;
+			}
+		}
+	}
+	free(want);
+	return mismatches;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Time sorting every set in c, including copying it in each time */
+static double time_sort(NSVGrasterizer *rast, const struct corpus *c,
+			void (*sort)(NSVGrasterizer *))
+{
+	double start = now_us();
+
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < c->n_sets; i++) {
+			load_set(rast, &c->sets[i]);
+			sort(rast);
+		}
+	}
+	return (now_us() - start) / ROUNDS;
+}
+
+/* Times just the copying, to take it out of the sort times */
+static void sort_none(NSVGrasterizer *rast)
+{
+	(void)rast;
+}
+
+static int run(NSVGrasterizer *rast, const struct corpus *c)
+{
+	char name[64];
+	double copy;
+	int mismatches;
+
+	if (!c->n_sets)
+		return 0;
+
+	mismatches = check(rast, c);
+	printf("edgesort/%s: %d shapes, %ld edges, %d mismatches\n", c->name,
+	       c->n_sets, c->n_edges, mismatches);
+
+	copy = time_sort(rast, c, sort_none);
+	snprintf(name, sizeof(name), "edgesort/%s/qsort", c->name);
+	printf("%-36s %10.1f us per pass\n", name,
+	       time_sort(rast, c, sort_qsort) - copy);
+	snprintf(name, sizeof(name), "edgesort/%s/radix", c->name);
+	printf("%-36s %10.1f us per pass\n", name,
+	       time_sort(rast, c, nsvg__sortEdges) - copy);
+
+	return mismatches;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "pbsplash-bench-edgesort [-l logo dir] [-f font]\n");
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	NSVGrasterizer *rast = nsvgCreateRasterizer();
+	int optflag, mismatches = 0;
+
+	while ((optflag = getopt(argc, argv, "l:f:")) != -1) {
+		switch (optflag) {
+		case 'l':
+			add_logos_in_dir(rast, optarg);
+			break;
+		case 'f':
+			add_font(rast, optarg);
+			break;
+		default:
+			return usage();
+		}
+	}
+
+	add_builtin_image(rast);
+	add_builtin_random();
+
+	mismatches += run(rast, &builtin);
+	mismatches += run(rast, &logos);
+	mismatches += run(rast, &glyphs);
+
+	nsvgDeleteRasterizer(rast);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+#ifndef __blit_h__
+#define __blit_h__
+
+#include <stdbool.h>
+#include <linux/fb.h>
+#include "pbsplash.h"
+
+/*
+ * Framebuffer pixel formats we have specialised blit kernels for. Names
+ * describe the packed pixel value from the most significant bit down, as
+ * reported by the fbdev bitfields (so XRGB8888 is red at bit 16, green at
+ * bit 8 and blue at bit 0).
+ */
+enum fb_format {
+	FB_FORMAT_UNKNOWN = 0,
+	FB_FORMAT_XRGB8888,
+	FB_FORMAT_ARGB8888,
+	FB_FORMAT_RGB888,
+	FB_FORMAT_RGB565,
+	FB_FORMAT_BGR565,
+};
+
+/*
+ * Blend count RGBA pixels from src over the background colour bg and store
+ * them to dst in the framebuffer's native format. Fully transparent pixels
+ * and pixels matching the background are left untouched.
+ */
+typedef void (*blit_row_fn)(unsigned char *dst, const struct col *src,
+			    int count, struct col bg);
+
+/*
+ * Draw the coverage mask in mask as count pixels to dst. lut holds the
+ * packed pixel value for every coverage level, see blit_tint_lut().
+ * Pixels without coverage are left untouched.
+ */
+typedef void (*blit_mask_row_fn)(unsigned char *dst, const unsigned char *mask,
+				 int count, const unsigned int *lut);
+
+/* Instruction sets the blit kernels are implemented for */
+enum blit_isa {
+	BLIT_ISA_SCALAR = 0,
+	BLIT_ISA_SSE2,
+	BLIT_ISA_AVX2,
+	BLIT_ISA_NEON,
+};
+
+/* x/255 rounded to nearest, exact for 0 <= x <= 255 * 255 */
+static inline unsigned char blit_div255(unsigned int x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+/*
+ * Blend c over the opaque background colour bg. This is the reference all
+ * the SIMD kernels have to match bit for bit.
+ */
+static inline struct col blit_blend(struct col c, struct col bg)
+{
+	unsigned int a = c.a, ia = 255 - c.a;
+
+	c.r = blit_div255(c.r * a + bg.r * ia);
+	c.g = blit_div255(c.g * a + bg.g * ia);
+	c.b = blit_div255(c.b * a + bg.b * ia);
+	return c;
+}
+
+enum fb_format blit_format_from_var(const struct fb_var_screeninfo *var);
+const char *blit_format_name(enum fb_format format);
+int blit_format_bpp(enum fb_format format);
+/* Case insensitive lookup by the names blit_format_name() returns */
+enum fb_format blit_format_from_name(const char *name);
+/* Pack an opaque colour into a pixel value of format */
+unsigned int blit_pack_color(enum fb_format format, struct col c);
+/* Read back the pixel at px, expanding 565 channels to 8 bits */
+struct col blit_unpack_color(enum fb_format format, const unsigned char *px);
+
+const char *blit_isa_name(enum blit_isa isa);
+enum blit_isa blit_best_isa(void);
+/* Kernel for format using isa, NULL if there isn't one or the CPU lacks isa */
+blit_row_fn blit_get_row_fn_isa(enum fb_format format, enum blit_isa isa);
+/* Fastest kernel for format the CPU supports */
+blit_row_fn blit_get_row_fn(enum fb_format format);
+
+/* Pixel values of the opaque colour c blended over bg at each coverage */
+void blit_tint_lut(enum fb_format format, struct col c, struct col bg,
+		   unsigned int lut[256]);
+/* Mask kernel for format, NULL if there isn't one */
+blit_mask_row_fn blit_get_mask_row_fn(enum fb_format format);
+
+/* Scalar reference kernels, the SIMD kernels use them for partial blocks */
+void blit_row_xrgb8888_c(unsigned char *dst, const struct col *src,
+			 int count, struct col bg);
+void blit_row_argb8888_c(unsigned char *dst, const struct col *src,
+			 int count, struct col bg);
+void blit_row_rgb888_c(unsigned char *dst, const struct col *src, int count,
+		       struct col bg);
+void blit_row_rgb565_c(unsigned char *dst, const struct col *src, int count,
+		       struct col bg);
+void blit_row_bgr565_c(unsigned char *dst, const struct col *src, int count,
+		       struct col bg);
+
+/* Coverage mask kernels, by framebuffer bytes per pixel */
+void blit_mask_row_32_c(unsigned char *dst, const unsigned char *mask,
+			int count, const unsigned int *lut);
+void blit_mask_row_24_c(unsigned char *dst, const unsigned char *mask,
+			int count, const unsigned int *lut);
+void blit_mask_row_16_c(unsigned char *dst, const unsigned char *mask,
+			int count, const unsigned int *lut);
+
+/* Implemented in blit_simd.c */
+blit_row_fn blit_simd_get_row_fn(enum fb_format format, enum blit_isa isa);
+bool blit_simd_supported(enum blit_isa isa);
+
+#endif
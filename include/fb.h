@@ -0,0 +1,69 @@
+#ifndef __fb_h__
+#define __fb_h__
+
+#include <stdbool.h>
+#include "blit.h"
+#include "pbsplash.h"
+
+/*
+ * Framebuffer backend. Everything pbsplash draws goes through here, either
+ * to the real framebuffer via tfblib or into an in-memory buffer when
+ * running headless (for testing and benchmarking on machines without a
+ * display).
+ */
+
+struct fb_headless_config {
+	int width;
+	int height;
+	/* Physical size, 0 if unknown */
+	int width_mm;
+	int height_mm;
+	enum fb_format format;
+};
+
+/*
+ * Parse a headless framebuffer spec of the form WxH[@WmmxHmm][:FORMAT],
+ * e.g. "1080x2340@68x147:RGB565". Returns 0 on success.
+ */
+int fb_parse_headless_spec(const char *spec, struct fb_headless_config *cfg);
+
+/* Acquire the framebuffer at fb_path through tfblib, returns a tfblib error */
+int fb_acquire(const char *fb_path, const char *tty);
+/* Allocate an in-memory framebuffer, returns 0 on success */
+int fb_acquire_headless(const struct fb_headless_config *cfg);
+void fb_release(void);
+
+int fb_width(void);
+int fb_height(void);
+int fb_width_mm(void);
+int fb_height_mm(void);
+bool fb_is_headless(void);
+
+void fb_clear(struct col c);
+void fb_fill_rect(int x, int y, int w, int h, struct col c);
+void fb_fill_circle(int cx, int cy, int r, struct col c);
+
+/*
+ * Blend the w x h RGBA image buf over bg and draw it at (x, y), flipped
+ * vertically if vflip is set.
+ */
+void fb_blit(const unsigned char *buf, int x, int y, int w, int h, bool vflip,
+	     struct col bg);
+
+/*
+ * Draw the w x h 8-bit coverage mask in colour c over bg at (x, y),
+ * flipped vertically if vflip is set.
+ */
+void fb_blit_mask(const unsigned char *mask, int x, int y, int w, int h,
+		  bool vflip, struct col c, struct col bg);
+
+void fb_flush(void);
+
+/*
+ * Write the current contents of the framebuffer to path, as PAM if the
+ * path ends in ".pam" and as binary PPM otherwise. Only possible when the
+ * framebuffer memory is directly accessible. Returns 0 on success.
+ */
+int fb_dump(const char *path);
+
+#endif
@@ -29,6 +29,8 @@
 #ifndef NANOSVG_H
 #define NANOSVG_H
 
+#include <stddef.h>
+
 #ifndef NANOSVG_CPLUSPLUS
 #ifdef __cplusplus
 extern "C" {
@@ -157,8 +159,23 @@ typedef struct NSVGshape
 	int horizAdvX;				// Horizontal distance to advance after rendering glyph.
 	NSVGpath* paths;			// Linked list of paths in the image.
 	struct NSVGshape* next;		// Pointer to next shape, or NULL if last element.
+	struct NSVGshape* nextGlyph;	// Next glyph whose unicode starts with the same character, longest first.
 } NSVGshape;
  
+typedef struct NSVGglyphEntry
+{
+	unsigned int codepoint;
+	NSVGshape* shape;			// NULL if the slot is free.
+} NSVGglyphEntry;
+
+// A block of memory the parts of an image are allocated from, the data follows the header.
+typedef struct NSVGarenaBlock
+{
+	struct NSVGarenaBlock* next;	// Previously filled block, or NULL.
+	size_t size;				// Bytes of data in the block.
+	size_t used;				// Bytes of data handed out.
+} NSVGarenaBlock;
+
 typedef struct NSVGimage
 {
 	float width;				// Width of the image.
@@ -167,6 +184,10 @@ typedef struct NSVGimage
 	int fontDescent;
 	int defaultHorizAdv;
 	NSVGshape* shapes;			// Linked list of shapes in the image.
+	NSVGshape* latin1Glyphs[256];	// Glyphs starting with U+0000 to U+00FF, by codepoint.
+	NSVGglyphEntry* glyphHash;	// Open addressed table of all other glyphs, by first codepoint.
+	int glyphHashSize;			// Number of slots in glyphHash, a power of two.
+	NSVGarenaBlock* arena;		// Blocks holding the image and everything it points to, newest first.
 } NSVGimage;
 
 // Parses SVG file from a file, returns SVG image as paths.
@@ -176,12 +197,35 @@ NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi)
 // Important note: changes the string.
 NSVGimage* nsvgParse(char* input, const char* units, float dpi);
 
+// Parses an SVG font, only keeping the outlines of glyphs made up of
+// characters in the UTF-8 string chars. The other glyphs are kept without
+// paths, so text using them can still be measured but draws nothing.
+NSVGimage* nsvgParseFontFromFile(const char* filename, const char* units, float dpi, const char* chars);
+NSVGimage* nsvgParseFont(char* input, const char* units, float dpi, const char* chars);
+
+// Parses an SVG file reading chunkSize bytes at a time (0 for 64 KB)
+// rather than the whole file at once, so only a chunk, or the longest tag
+// if that is bigger, is in memory next to the image being built.
+NSVGimage* nsvgParseFromFileChunked(const char* filename, const char* units, float dpi, size_t chunkSize);
+NSVGimage* nsvgParseFontFromFileChunked(const char* filename, const char* units, float dpi, const char* chars, size_t chunkSize);
+
 // Duplicates a path.
 NSVGpath* nsvgDuplicatePath(NSVGpath* p);
 
 // Deletes an image.
 void nsvgDelete(NSVGimage* image);
 
+// Returns the glyph for a single codepoint, NULL if the font has none.
+NSVGshape* nsvgGetGlyph(const NSVGimage* image, unsigned int codepoint);
+
+// Returns the glyph for the UTF-8 text at s, preferring the longest
+// ligature that matches. Sets *glyphLen to the number of bytes the glyph
+// covers, or to the length of the first character if there is no glyph.
+NSVGshape* nsvgGetTextGlyph(const NSVGimage* image, const char* s, int len, int* glyphLen);
+
+// Looks up the glyphs for the UTF-8 string text with nsvgGetTextGlyph().
+// The result has one entry per byte, each glyph is stored at the first
+// byte it covers. Free the result with free().
 NSVGshape** nsvgGetTextShapes(const NSVGimage* image, const char* text, int textLen);
 
 #ifndef NANOSVG_CPLUSPLUS
@@ -198,6 +242,25 @@ NSVGshape** nsvgGetTextShapes(const NSVGimage* image, const char* text, int text
 #include <stdlib.h>
 #include <math.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define NSVG_HAVE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Vector scanning for the XML tokenizer needs GCC or Clang builtins
+#if defined(__GNUC__) && defined(__SSE2__)
+#define NSVG_HAVE_SSE2 1
+#include <stdint.h>
+#include <emmintrin.h>
+#elif defined(__GNUC__) && defined(__ARM_NEON)
+#define NSVG_HAVE_NEON 1
+#include <stdint.h>
+#include <arm_neon.h>
+#endif
+
 #define NSVG_PI (3.14159265358979323846264338327f)
 #define NSVG_KAPPA90 (0.5522847493f)	// Length proportional to radius of a cubic bezier handle for 90deg arcs.
 
@@ -226,7 +289,8 @@ NSVGshape** nsvgGetTextShapes(const NSVGimage* image, const char* text, int text
 
 static int nsvg__isspace(char c)
 {
-	return strchr(" \t\n\v\f\r", c) != 0;
+	// Also true for '\0', like the strchr() this replaced; callers check for it
+	return c == ' ' || (c >= '\t' && c <= '\r') || c == '\0';
 }
 
 static int nsvg__isdigit(char c)
@@ -240,10 +304,63 @@ static NSVG_INLINE float nsvg__maxf(float a, float b) { return a > b ? a : b; }
 
 // Simple XML parser
 
-#define NSVG_XML_TAG 1
-#define NSVG_XML_CONTENT 2
 #define NSVG_XML_MAX_ATTRIBS 256
 
+// Returns the first c or '\0' in s. The vector versions read whole aligned
+// 16 byte blocks, which may run past the terminator but never into another
+// page, so they can't fault; only the address sanitizer has to be told.
+#if defined(NSVG_HAVE_SSE2)
+__attribute__((no_sanitize_address))
+static char* nsvg__findChar(char* s, char c)
+{
+	const __m128i needle = _mm_set1_epi8(c);
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int offset = (uintptr_t)s & 15;
+	const __m128i* p = (const __m128i*)(s - offset);
+	__m128i v = _mm_load_si128(p);
+	unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, needle), _mm_cmpeq_epi8(v, zero)));
+
+	// Ignore the bytes before s in the first block
+	mask &= ~0u << offset;
+	while (!mask) {
+		v = _mm_load_si128(++p);
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, needle), _mm_cmpeq_epi8(v, zero)));
+	}
+	return (char*)p + __builtin_ctz(mask);
+}
+#elif defined(NSVG_HAVE_NEON)
+// NEON has no movemask; narrowing the compare result gives 4 bits per byte
+static NSVG_INLINE uint64_t nsvg__neonMask(const uint8_t* p, uint8x16_t needle)
+{
+	uint8x16_t v = vld1q_u8(p);
+	uint8x16_t eq = vorrq_u8(vceqq_u8(v, needle), vceqq_u8(v, vdupq_n_u8(0)));
+	return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+__attribute__((no_sanitize_address))
+static char* nsvg__findChar(char* s, char c)
+{
+	const uint8x16_t needle = vdupq_n_u8((uint8_t)c);
+	unsigned int offset = (uintptr_t)s & 15;
+	const uint8_t* p = (const uint8_t*)(s - offset);
+	uint64_t mask = nsvg__neonMask(p, needle);
+
+	// Ignore the bytes before s in the first block
+	mask &= ~0ull << (offset * 4);
+	while (!mask) {
+		p += 16;
+		mask = nsvg__neonMask(p, needle);
+	}
+	return (char*)p + (__builtin_ctzll(mask) >> 2);
+}
+#else
+static char* nsvg__findChar(char* s, char c)
+{
+	while (*s && *s != c) s++;
+	return s;
+}
+#endif
+
 static void nsvg__parseContent(char* s,
 							   void (*contentCb)(void* ud, const char* s),
 							   void* ud)
@@ -311,7 +428,7 @@ static void nsvg__parseElement(char* s,
 		s++;
 		// Store value and find the end of it.
 		value = s;
-		while (*s && *s != quote) s++;
+		s = nsvg__findChar(s, quote);
 		if (*s) { *s++ = '\0'; }
 
 		// Store only well formed attributes
@@ -332,32 +449,45 @@ static void nsvg__parseElement(char* s,
 		(*endelCb)(ud, name);
 }
 
-int nsvg__parseXML(char* input,
-				   void (*startelCb)(void* ud, const char* el, const char** attr),
-				   void (*endelCb)(void* ud, const char* el),
-				   void (*contentCb)(void* ud, const char* s),
-				   void* ud)
+// Calls the callbacks for every complete tag and content from s on, where
+// *mark is the start of the current token and *inTag tells if it's a tag.
+// Returns the terminator, with *mark and *inTag left at the token it cuts
+// short, so parsing can resume there once more input is appended.
+static char* nsvg__scanXML(char* s, char** mark, int* inTag,
+						   void (*startelCb)(void* ud, const char* el, const char** attr),
+						   void (*endelCb)(void* ud, const char* el),
+						   void (*contentCb)(void* ud, const char* s),
+						   void* ud)
 {
-	char* s = input;
-	char* mark = s;
-	int state = NSVG_XML_CONTENT;
-	while (*s) {
-		if (*s == '<' && state == NSVG_XML_CONTENT) {
+	for (;;) {
+		if (!*inTag) {
 			// Start of a tag
+			s = nsvg__findChar(s, '<');
+			if (!*s) return s;
 			*s++ = '\0';
-			nsvg__parseContent(mark, contentCb, ud);
-			mark = s;
-			state = NSVG_XML_TAG;
-		} else if (*s == '>' && state == NSVG_XML_TAG) {
+			nsvg__parseContent(*mark, contentCb, ud);
+		} else {
 			// Start of a content or new tag.
+			s = nsvg__findChar(s, '>');
+			if (!*s) return s;
 			*s++ = '\0';
-			nsvg__parseElement(mark, startelCb, endelCb, ud);
-			mark = s;
-			state = NSVG_XML_CONTENT;
-		} else {
-			s++;
+			nsvg__parseElement(*mark, startelCb, endelCb, ud);
 		}
+		*mark = s;
+		*inTag = !*inTag;
 	}
+}
+
+int nsvg__parseXML(char* input,
+				   void (*startelCb)(void* ud, const char* el, const char** attr),
+				   void (*endelCb)(void* ud, const char* el),
+				   void (*contentCb)(void* ud, const char* s),
+				   void* ud)
+{
+	char* mark = input;
+	int inTag = 0;
+
+	nsvg__scanXML(input, &mark, &inTag, startelCb, endelCb, contentCb, ud);
 
 	return 1;
 }
@@ -462,7 +592,9 @@ typedef struct NSVGparser
 	char pathFlag;
 	char defsFlag;
 	char unicodeFlag[NSVG_MAX_UNICODE_LEN];
-	const char *horizAdvFlag;
+	int horizAdvFlag;			// horiz-adv-x of the glyph being parsed, 0 for the default
+	unsigned int* glyphFilter;	// Sorted codepoints of the glyphs to keep, NULL for all
+	int nglyphFilter;
 } NSVGparser;
 
 static void nsvg__xformIdentity(float* t)
@@ -622,16 +754,52 @@ static void nsvg__curveBounds(float* bounds, float* curve)
 	}
 }
 
+#define NSVG__ARENA_ALIGN 8
+#define NSVG__ARENA_MIN_BLOCK 4096
+#define NSVG__ARENA_MAX_BLOCK (1024*1024)
+
+// Allocates size bytes from the arena, adding a block if the newest one is full.
+static void* nsvg__arenaAlloc(NSVGarenaBlock** arena, size_t size)
+{
+	NSVGarenaBlock* block = *arena;
+	size_t blockSize;
+	char* ptr;
+
+	size = (size + NSVG__ARENA_ALIGN-1) & ~(size_t)(NSVG__ARENA_ALIGN-1);
+	if (block == NULL || block->size - block->used < size) {
+		// Grow the blocks with the image, so small images stay small.
+		blockSize = block ? block->size*2 : NSVG__ARENA_MIN_BLOCK;
+		if (blockSize > NSVG__ARENA_MAX_BLOCK) blockSize = NSVG__ARENA_MAX_BLOCK;
+		if (blockSize < size) blockSize = size;
+		block = (NSVGarenaBlock*)malloc(sizeof(NSVGarenaBlock) + blockSize);
+		if (block == NULL) return NULL;
+		block->next = *arena;
+		block->size = blockSize;
+		block->used = 0;
+		*arena = block;
+	}
+	ptr = (char*)(block + 1) + block->used;
+	block->used += size;
+	return ptr;
+}
+
+static void* nsvg__parserAlloc(NSVGparser* p, size_t size)
+{
+	return nsvg__arenaAlloc(&p->image->arena, size);
+}
+
 static NSVGparser* nsvg__createParser()
 {
 	NSVGparser* p;
+	NSVGarenaBlock* arena = NULL;
 	p = (NSVGparser*)malloc(sizeof(NSVGparser));
 	if (p == NULL) goto error;
 	memset(p, 0, sizeof(NSVGparser));
 
-	p->image = (NSVGimage*)malloc(sizeof(NSVGimage));
+	p->image = (NSVGimage*)nsvg__arenaAlloc(&arena, sizeof(NSVGimage));
 	if (p->image == NULL) goto error;
 	memset(p->image, 0, sizeof(NSVGimage));
+	p->image->arena = arena;
 
 	// Init style
 	nsvg__xformIdentity(p->attr[0].xform);
@@ -653,30 +821,10 @@ static NSVGparser* nsvg__createParser()
 	return p;
 
 error:
-	if (p) {
-		if (p->image) free(p->image);
-		free(p);
-	}
+	free(p);
 	return NULL;
 }
 
-static void nsvg__deletePaths(NSVGpath* path)
-{
-	while (path) {
-		NSVGpath *next = path->next;
-		if (path->pts != NULL)
-			free(path->pts);
-		free(path);
-		path = next;
-	}
-}
-
-static void nsvg__deletePaint(NSVGpaint* paint)
-{
-	if (paint->type == NSVG_PAINT_LINEAR_GRADIENT || paint->type == NSVG_PAINT_RADIAL_GRADIENT)
-		free(paint->gradient);
-}
-
 static void nsvg__deleteGradientData(NSVGgradientData* grad)
 {
 	NSVGgradientData* next;
@@ -691,10 +839,10 @@ static void nsvg__deleteGradientData(NSVGgradientData* grad)
 static void nsvg__deleteParser(NSVGparser* p)
 {
 	if (p != NULL) {
-		nsvg__deletePaths(p->plist);
 		nsvg__deleteGradientData(p->gradients);
 		nsvgDelete(p->image);
 		free(p->pts);
+		free(p->glyphFilter);
 		free(p);
 	}
 }
@@ -826,6 +974,16 @@ static NSVGgradientData* nsvg__findGradientData(NSVGparser* p, const char* id)
 	return NULL;
 }
 
+// Converts a gradient coordinate, where plain numbers in objectBoundingBox
+// units are fractions of the bounds rather than user space units
+static float nsvg__convertGradientCoord(NSVGparser* p, NSVGgradientData* data, NSVGcoordinate c,
+										float orig, float length)
+{
+	if (data->units == NSVG_OBJECT_SPACE && c.units == NSVG_UNITS_USER)
+		return orig + c.value * length;
+	return nsvg__convertToPixels(p, c, orig, length);
+}
+
 static NSVGgradient* nsvg__createGradient(NSVGparser* p, const char* id, const float* localBounds, char* paintType)
 {
 	NSVGattrib* attr = nsvg__getAttr(p);
@@ -858,7 +1016,7 @@ static NSVGgradient* nsvg__createGradient(NSVGparser* p, const char* id, const f
 	}
 	if (stops == NULL) return NULL;
 
-	grad = (NSVGgradient*)malloc(sizeof(NSVGgradient) + sizeof(NSVGgradientStop)*(nstops-1));
+	grad = (NSVGgradient*)nsvg__parserAlloc(p, sizeof(NSVGgradient) + sizeof(NSVGgradientStop)*(nstops-1));
 	if (grad == NULL) return NULL;
 
 	// The shape width and height.
@@ -877,10 +1035,10 @@ static NSVGgradient* nsvg__createGradient(NSVGparser* p, const char* id, const f
 
 	if (data->type == NSVG_PAINT_LINEAR_GRADIENT) {
 		float x1, y1, x2, y2, dx, dy;
-		x1 = nsvg__convertToPixels(p, data->linear.x1, ox, sw);
-		y1 = nsvg__convertToPixels(p, data->linear.y1, oy, sh);
-		x2 = nsvg__convertToPixels(p, data->linear.x2, ox, sw);
-		y2 = nsvg__convertToPixels(p, data->linear.y2, oy, sh);
+		x1 = nsvg__convertGradientCoord(p, data, data->linear.x1, ox, sw);
+		y1 = nsvg__convertGradientCoord(p, data, data->linear.y1, oy, sh);
+		x2 = nsvg__convertGradientCoord(p, data, data->linear.x2, ox, sw);
+		y2 = nsvg__convertGradientCoord(p, data, data->linear.y2, oy, sh);
 		// Calculate transform aligned to the line
 		dx = x2 - x1;
 		dy = y2 - y1;
@@ -889,11 +1047,11 @@ static NSVGgradient* nsvg__createGradient(NSVGparser* p, const char* id, const f
 		grad->xform[4] = x1; grad->xform[5] = y1;
 	} else {
 		float cx, cy, fx, fy, r;
-		cx = nsvg__convertToPixels(p, data->radial.cx, ox, sw);
-		cy = nsvg__convertToPixels(p, data->radial.cy, oy, sh);
-		fx = nsvg__convertToPixels(p, data->radial.fx, ox, sw);
-		fy = nsvg__convertToPixels(p, data->radial.fy, oy, sh);
-		r = nsvg__convertToPixels(p, data->radial.r, 0, sl);
+		cx = nsvg__convertGradientCoord(p, data, data->radial.cx, ox, sw);
+		cy = nsvg__convertGradientCoord(p, data, data->radial.cy, oy, sh);
+		fx = nsvg__convertGradientCoord(p, data, data->radial.fx, ox, sw);
+		fy = nsvg__convertGradientCoord(p, data, data->radial.fy, oy, sh);
+		r = nsvg__convertGradientCoord(p, data, data->radial.r, 0, sl);
 		// Calculate transform aligned to the circle
 		grad->xform[0] = r; grad->xform[1] = 0;
 		grad->xform[2] = 0; grad->xform[3] = r;
@@ -951,20 +1109,60 @@ static void nsvg__getLocalBounds(float* bounds, NSVGshape *shape, float* xform)
 	}
 }
 
+static void nsvg__appendShape(NSVGparser* p, NSVGshape* shape)
+{
+	if (p->image->shapes == NULL)
+		p->image->shapes = shape;
+	else
+		p->shapesTail->next = shape;
+	p->shapesTail = shape;
+}
+
+// Moves the unicode and advance of the glyph being parsed to shape
+static void nsvg__takeGlyphMetrics(NSVGparser* p, NSVGshape* shape)
+{
+	if (p->unicodeFlag[0]) {
+		strcat(shape->unicode, p->unicodeFlag);
+		shape->horizAdvX = p->horizAdvFlag;
+		if (shape->horizAdvX == 0) {
+			shape->horizAdvX = p->image->defaultHorizAdv;
+		}
+		p->unicodeFlag[0] = '\0';
+		p->horizAdvFlag = 0;
+	}
+}
+
+// Adds a glyph without paths, for glyphs the glyph filter leaves out
+static void nsvg__addGlyphStub(NSVGparser* p)
+{
+	NSVGattrib* attr = nsvg__getAttr(p);
+	NSVGshape* shape;
+
+	shape = (NSVGshape*)nsvg__parserAlloc(p, sizeof(NSVGshape));
+	if (shape == NULL) return;
+	memset(shape, 0, sizeof(NSVGshape));
+
+	memcpy(shape->id, attr->id, sizeof shape->id);
+	nsvg__takeGlyphMetrics(p, shape);
+	shape->opacity = attr->opacity;
+	shape->flags = (attr->visible ? NSVG_FLAGS_VISIBLE : 0x00);
+
+	nsvg__appendShape(p, shape);
+}
+
 static void nsvg__addShape(NSVGparser* p)
 {
 	NSVGattrib* attr = nsvg__getAttr(p);
 	float scale = 1.0f;
 	NSVGshape* shape;
-	char *end;
 	NSVGpath* path;
 	int i;
 
 	if (p->plist == NULL)
 		return;
 
-	shape = (NSVGshape*)malloc(sizeof(NSVGshape));
-	if (shape == NULL) goto error;
+	shape = (NSVGshape*)nsvg__parserAlloc(p, sizeof(NSVGshape));
+	if (shape == NULL) return;
 	memset(shape, 0, sizeof(NSVGshape));
 
 	memcpy(shape->id, attr->id, sizeof shape->id);
@@ -980,19 +1178,7 @@ static void nsvg__addShape(NSVGparser* p)
 	shape->fillRule = attr->fillRule;
 	shape->opacity = attr->opacity;
 
-	if (p->unicodeFlag[0]) {
-		strcat(shape->unicode, p->unicodeFlag);
-		if (p->horizAdvFlag) {
-			shape->horizAdvX = strtol(p->horizAdvFlag, &end, 10);
-			if (end == p->horizAdvFlag)
-				shape->horizAdvX = 0;
-		}
-		if (shape->horizAdvX == 0) {
-			shape->horizAdvX = p->image->defaultHorizAdv;
-		}
-		p->unicodeFlag[0] = '\0';
-		p->horizAdvFlag = NULL;
-	}
+	nsvg__takeGlyphMetrics(p, shape);
 
 	shape->paths = p->plist;
 	p->plist = NULL;
@@ -1045,17 +1231,7 @@ static void nsvg__addShape(NSVGparser* p)
 	// Set flags
 	shape->flags = (attr->visible ? NSVG_FLAGS_VISIBLE : 0x00);
 
-	// Add to tail
-	if (p->image->shapes == NULL)
-		p->image->shapes = shape;
-	else
-		p->shapesTail->next = shape;
-	p->shapesTail = shape;
-
-	return;
-
-error:
-	if (shape) free(shape);
+	nsvg__appendShape(p, shape);
 }
 
 static void nsvg__addPath(NSVGparser* p, char closed)
@@ -1076,12 +1252,12 @@ static void nsvg__addPath(NSVGparser* p, char closed)
 	if ((p->npts % 3) != 1)
 		return;
 
-	path = (NSVGpath*)malloc(sizeof(NSVGpath));
-	if (path == NULL) goto error;
+	path = (NSVGpath*)nsvg__parserAlloc(p, sizeof(NSVGpath));
+	if (path == NULL) return;
 	memset(path, 0, sizeof(NSVGpath));
 
-	path->pts = (float*)malloc(p->npts*2*sizeof(float));
-	if (path->pts == NULL) goto error;
+	path->pts = (float*)nsvg__parserAlloc(p, p->npts*2*sizeof(float));
+	if (path->pts == NULL) return;
 	path->closed = closed;
 	path->npts = p->npts;
 
@@ -1108,18 +1284,11 @@ static void nsvg__addPath(NSVGparser* p, char closed)
 
 	path->next = p->plist;
 	p->plist = path;
-
-	return;
-
-error:
-	if (path != NULL) {
-		if (path->pts != NULL) free(path->pts);
-		free(path);
-	}
 }
 
-// We roll our own string to float because the std library one uses locale and messes things up.
-static double nsvg__atof(const char* s)
+// Parses a number the way nsvg__atof() used to, with strtoll() and pow(). Kept
+// for the numbers the fast path below can't do exactly the same way.
+static double nsvg__atofSlow(const char* s)
 {
 	char* cur = (char*)s;
 	char* end = NULL;
@@ -1177,6 +1346,57 @@ static double nsvg__atof(const char* s)
 	return res * sign;
 }
 
+// Powers of ten for the fraction, all held exactly by a double.
+static const double nsvg__pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+// We roll our own string to float because the std library one uses locale and messes things up.
+// Numbers without an exponent and with at most 18 digits on either side of
+// the point are accumulated in a single pass, and combined with the same
+// arithmetic nsvg__atofSlow() uses, so the result is the same to the bit.
+static double nsvg__atof(const char* s)
+{
+	const char* cur = s;
+	unsigned long long intPart = 0, fracPart = 0;
+	int intDigits = 0, fracDigits = 0;
+	double res, sign = 1.0;
+
+	if (*cur == '+') {
+		cur++;
+	} else if (*cur == '-') {
+		sign = -1;
+		cur++;
+	}
+
+	while (nsvg__isdigit(*cur)) {
+		intPart = intPart*10 + (unsigned)(*cur - '0');
+		intDigits++;
+		cur++;
+	}
+	if (*cur == '.') {
+		cur++;
+		while (nsvg__isdigit(*cur)) {
+			fracPart = fracPart*10 + (unsigned)(*cur - '0');
+			fracDigits++;
+			cur++;
+		}
+	}
+
+	// Too many digits for a long long, or a scale outside the table.
+	if (intDigits > 18 || fracDigits > 18 || *cur == 'e' || *cur == 'E')
+		return nsvg__atofSlow(s);
+
+	if (intDigits == 0 && fracDigits == 0)
+		return 0.0;
+
+	res = (double)intPart;
+	if (fracDigits > 0)
+		res += (double)fracPart / nsvg__pow10[fracDigits];
+
+	return res * sign;
+}
 
 static const char* nsvg__parseNumber(const char* s, char* it, const int size)
 {
@@ -1418,15 +1638,288 @@ NSVGNamedColor nsvg__colors[] = {
 #endif
 };
 
+// FNV-1a, from a seed the perfect hash tables below were generated with.
+static unsigned int nsvg__hashName(const char* s, unsigned int seed)
+{
+	unsigned int h = seed;
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+#define NSVG__HASH_SLOT(s, seed, bits) (nsvg__hashName(s, seed) >> (32 - (bits)))
+
+// Perfect hash tables of the element names, attribute names and colour
+// keywords the parser knows. Each slot holds one plus the index of the only
+// name that can be in it, or 0. Generated by tools/gen-nanosvg-hash.py.
+// BEGIN GENERATED HASH TABLES
+enum NSVGelementId {
+	NSVG_ELEMENT_UNKNOWN = 0,
+	NSVG_ELEMENT_CIRCLE,
+	NSVG_ELEMENT_DEFS,
+	NSVG_ELEMENT_ELLIPSE,
+	NSVG_ELEMENT_FONT,
+	NSVG_ELEMENT_FONT_FACE,
+	NSVG_ELEMENT_G,
+	NSVG_ELEMENT_GLYPH,
+	NSVG_ELEMENT_LINE,
+	NSVG_ELEMENT_LINEAR_GRADIENT,
+	NSVG_ELEMENT_PATH,
+	NSVG_ELEMENT_POLYGON,
+	NSVG_ELEMENT_POLYLINE,
+	NSVG_ELEMENT_RADIAL_GRADIENT,
+	NSVG_ELEMENT_RECT,
+	NSVG_ELEMENT_STOP,
+	NSVG_ELEMENT_SVG,
+};
+
+static const char* nsvg__elementNames[] = {
+	"",
+	"circle",
+	"defs",
+	"ellipse",
+	"font",
+	"font-face",
+	"g",
+	"glyph",
+	"line",
+	"linearGradient",
+	"path",
+	"polygon",
+	"polyline",
+	"radialGradient",
+	"rect",
+	"stop",
+	"svg",
+};
+
+#define NSVG__ELEMENT_SEED 0x00000037u
+#define NSVG__ELEMENT_BITS 5
+static const unsigned char nsvg__elementHash[32] = {
+	10, 0, 0, 4, 13, 11, 0, 0, 1, 0, 6, 14, 16, 0, 0, 9,
+	12, 0, 3, 0, 0, 7, 0, 2, 0, 5, 0, 15, 0, 0, 8, 0,
+};
+
+enum NSVGattrId {
+	NSVG_ATTR_UNKNOWN = 0,
+	NSVG_ATTR_ASCENT,
+	NSVG_ATTR_CX,
+	NSVG_ATTR_CY,
+	NSVG_ATTR_D,
+	NSVG_ATTR_DESCENT,
+	NSVG_ATTR_DISPLAY,
+	NSVG_ATTR_FILL,
+	NSVG_ATTR_FILL_OPACITY,
+	NSVG_ATTR_FILL_RULE,
+	NSVG_ATTR_FONT_SIZE,
+	NSVG_ATTR_FX,
+	NSVG_ATTR_FY,
+	NSVG_ATTR_GRADIENT_TRANSFORM,
+	NSVG_ATTR_GRADIENT_UNITS,
+	NSVG_ATTR_HEIGHT,
+	NSVG_ATTR_HORIZ_ADV_X,
+	NSVG_ATTR_ID,
+	NSVG_ATTR_OFFSET,
+	NSVG_ATTR_OPACITY,
+	NSVG_ATTR_POINTS,
+	NSVG_ATTR_PRESERVE_ASPECT_RATIO,
+	NSVG_ATTR_R,
+	NSVG_ATTR_RX,
+	NSVG_ATTR_RY,
+	NSVG_ATTR_SPREAD_METHOD,
+	NSVG_ATTR_STOP_COLOR,
+	NSVG_ATTR_STOP_OPACITY,
+	NSVG_ATTR_STROKE,
+	NSVG_ATTR_STROKE_DASHARRAY,
+	NSVG_ATTR_STROKE_DASHOFFSET,
+	NSVG_ATTR_STROKE_LINECAP,
+	NSVG_ATTR_STROKE_LINEJOIN,
+	NSVG_ATTR_STROKE_MITERLIMIT,
+	NSVG_ATTR_STROKE_OPACITY,
+	NSVG_ATTR_STROKE_WIDTH,
+	NSVG_ATTR_STYLE,
+	NSVG_ATTR_TRANSFORM,
+	NSVG_ATTR_UNICODE,
+	NSVG_ATTR_VIEW_BOX,
+	NSVG_ATTR_WIDTH,
+	NSVG_ATTR_X,
+	NSVG_ATTR_X1,
+	NSVG_ATTR_X2,
+	NSVG_ATTR_XLINK_HREF,
+	NSVG_ATTR_Y,
+	NSVG_ATTR_Y1,
+	NSVG_ATTR_Y2,
+};
+
+static const char* nsvg__attrNames[] = {
+	"",
+	"ascent",
+	"cx",
+	"cy",
+	"d",
+	"descent",
+	"display",
+	"fill",
+	"fill-opacity",
+	"fill-rule",
+	"font-size",
+	"fx",
+	"fy",
+	"gradientTransform",
+	"gradientUnits",
+	"height",
+	"horiz-adv-x",
+	"id",
+	"offset",
+	"opacity",
+	"points",
+	"preserveAspectRatio",
+	"r",
+	"rx",
+	"ry",
+	"spreadMethod",
+	"stop-color",
+	"stop-opacity",
+	"stroke",
+	"stroke-dasharray",
+	"stroke-dashoffset",
+	"stroke-linecap",
+	"stroke-linejoin",
+	"stroke-miterlimit",
+	"stroke-opacity",
+	"stroke-width",
+	"style",
+	"transform",
+	"unicode",
+	"viewBox",
+	"width",
+	"x",
+	"x1",
+	"x2",
+	"xlink:href",
+	"y",
+	"y1",
+	"y2",
+};
+
+#define NSVG__ATTR_SEED 0x0000011cu
+#define NSVG__ATTR_BITS 8
+static const unsigned char nsvg__attrHash[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 18,
+	0, 0, 13, 0, 0, 0, 27, 0, 0, 0, 19, 33, 0, 0, 0, 39,
+	0, 44, 29, 14, 0, 0, 0, 0, 0, 0, 0, 0, 0, 35, 0, 0,
+	0, 0, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 1, 0, 20, 0, 0, 0, 25, 26, 0, 0, 0, 0, 34, 5,
+	0, 31, 0, 0, 0, 0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 41, 45, 0, 0, 0, 0, 0, 0, 0, 0, 22, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 17, 0, 23,
+	24, 30, 0, 8, 3, 2, 0, 11, 12, 6, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 21, 0, 0,
+	0, 0, 15, 0, 0, 0, 0, 0, 28, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 9, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 42, 43, 0, 47,
+	46, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 40, 0,
+	0, 0, 36, 0, 0, 0, 32, 0, 0, 38, 0, 0, 0, 0, 37, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+#ifdef NANOSVG_ALL_COLOR_KEYWORDS
+#define NSVG__COLOR_SEED 0x00006a71u
+#define NSVG__COLOR_BITS 10
+static const unsigned char nsvg__colorHash[1024] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 135, 0, 59, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 38, 0,
+	0, 0, 90, 0, 126, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 89, 0, 0, 0, 0, 51, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 20, 0, 0, 117, 0, 0, 0, 72, 0, 57, 0,
+	0, 0, 0, 0, 48, 0, 0, 0, 0, 0, 0, 50, 0, 0, 0, 0,
+	0, 0, 64, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 108, 0, 0, 0, 0, 0, 0, 0, 0, 15, 0,
+	85, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 49, 0, 100,
+	0, 0, 0, 0, 0, 0, 0, 0, 26, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 31, 0, 41, 0, 0, 14, 3, 0, 37, 0, 0, 131, 0, 0, 0,
+	123, 139, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 144, 0, 0, 0, 0, 0, 0, 44, 0, 0, 0, 0, 36, 0,
+	125, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 137, 106, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 45, 0, 0, 121, 0, 0, 0,
+	25, 0, 0, 0, 0, 0, 115, 0, 0, 0, 0, 143, 0, 0, 0, 0,
+	0, 0, 0, 119, 0, 0, 0, 0, 124, 0, 18, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 107, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 147, 1, 0, 0, 28, 0, 0, 0, 0, 0, 0, 0,
+	110, 0, 0, 63, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	92, 98, 105, 0, 0, 0, 0, 111, 0, 0, 0, 75, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5, 9, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 132, 0, 0, 0,
+	42, 0, 129, 87, 67, 0, 0, 0, 0, 0, 0, 0, 0, 8, 0, 0,
+	0, 0, 0, 52, 0, 0, 0, 120, 0, 0, 0, 0, 0, 0, 73, 0,
+	0, 0, 116, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 145, 0, 0, 35, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 40, 0, 0, 0, 0, 0, 0, 27,
+	0, 0, 0, 0, 0, 0, 0, 0, 19, 0, 0, 0, 128, 70, 0, 0,
+	0, 94, 0, 138, 11, 0, 0, 0, 102, 0, 56, 68, 0, 0, 0, 0,
+	0, 127, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 76, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 0, 0,
+	39, 0, 80, 0, 0, 0, 0, 0, 0, 65, 0, 0, 0, 0, 0, 29,
+	0, 78, 109, 0, 0, 0, 0, 0, 0, 0, 133, 0, 0, 0, 91, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 71, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 122, 0, 17, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 54, 0, 0, 118, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+	0, 61, 0, 23, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 66, 0, 0, 0, 69, 0, 60, 0, 0, 0, 0, 0,
+	0, 22, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 97, 0, 0, 0, 0, 0, 81, 0, 53, 0, 0, 0, 136,
+	0, 0, 0, 13, 0, 0, 0, 0, 0, 0, 0, 2, 103, 21, 0, 0,
+	0, 79, 0, 0, 0, 0, 10, 0, 0, 0, 0, 0, 0, 43, 0, 0,
+	0, 0, 0, 24, 0, 0, 0, 32, 0, 0, 0, 0, 0, 0, 99, 0,
+	95, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 7, 140, 0, 34, 0, 82, 0, 0, 0, 0, 0, 0,
+	130, 0, 0, 0, 0, 0, 0, 0, 0, 0, 141, 0, 0, 0, 62, 93,
+	0, 0, 47, 0, 0, 0, 0, 0, 0, 0, 0, 83, 0, 0, 0, 0,
+	33, 0, 0, 0, 0, 0, 96, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 46, 0, 0, 0, 0, 0, 0, 0, 0, 0, 84, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 77,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 146, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 55, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	86, 0, 0, 0, 0, 74, 0, 0, 0, 0, 101, 0, 0, 0, 0, 0,
+	114, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 104, 0, 0, 0, 30,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 12, 0, 0, 0, 0,
+	0, 113, 0, 0, 0, 58, 0, 0, 0, 0, 0, 0, 0, 142, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 134, 0, 0, 112, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 88, 0, 0, 0, 0, 0,
+};
+#else
+#define NSVG__COLOR_SEED 0x00000002u
+#define NSVG__COLOR_BITS 5
+static const unsigned char nsvg__colorHash[32] = {
+	2, 0, 10, 1, 4, 0, 0, 0, 0, 0, 0, 7, 0, 0, 9, 8,
+	0, 0, 0, 0, 0, 0, 0, 0, 5, 0, 6, 0, 0, 0, 3, 0,
+};
+#endif
+// END GENERATED HASH TABLES
+
+static int nsvg__elementId(const char* name)
+{
+	int id = nsvg__elementHash[NSVG__HASH_SLOT(name, NSVG__ELEMENT_SEED, NSVG__ELEMENT_BITS)];
+	return strcmp(nsvg__elementNames[id], name) == 0 ? id : NSVG_ELEMENT_UNKNOWN;
+}
+
+static int nsvg__attrId(const char* name)
+{
+	int id = nsvg__attrHash[NSVG__HASH_SLOT(name, NSVG__ATTR_SEED, NSVG__ATTR_BITS)];
+	return strcmp(nsvg__attrNames[id], name) == 0 ? id : NSVG_ATTR_UNKNOWN;
+}
+
 static unsigned int nsvg__parseColorName(const char* str)
 {
-	int i, ncolors = sizeof(nsvg__colors) / sizeof(NSVGNamedColor);
+	int i = nsvg__colorHash[NSVG__HASH_SLOT(str, NSVG__COLOR_SEED, NSVG__COLOR_BITS)];
 
-	for (i = 0; i < ncolors; i++) {
-		if (strcmp(nsvg__colors[i].name, str) == 0) {
-			return nsvg__colors[i].color;
-		}
-	}
+	if (i > 0 && strcmp(nsvg__colors[i-1].name, str) == 0)
+		return nsvg__colors[i-1].color;
 
 	return NSVG_RGB(128, 128, 128);
 }
@@ -1751,20 +2244,24 @@ static int nsvg__parseStrokeDashArray(NSVGparser* p, const char* str, float* str
 
 static void nsvg__parseStyle(NSVGparser* p, const char* str);
 
-static int nsvg__parseAttr(NSVGparser* p, const char* name, const char* value)
+// Parses the presentation attribute or style property id, returns 0 if
+// id isn't one.
+static int nsvg__parseAttrId(NSVGparser* p, int id, const char* value)
 {
 	float xform[6];
 	NSVGattrib* attr = nsvg__getAttr(p);
 	if (!attr) return 0;
 
-	if (strcmp(name, "style") == 0) {
+	switch (id) {
+	case NSVG_ATTR_STYLE:
 		nsvg__parseStyle(p, value);
-	} else if (strcmp(name, "display") == 0) {
+		break;
+	case NSVG_ATTR_DISPLAY:
 		if (strcmp(value, "none") == 0)
 			attr->visible = 0;
 		// Don't reset ->visible on display:inline, one display:none hides the whole subtree
-
-	} else if (strcmp(name, "fill") == 0) {
+		break;
+	case NSVG_ATTR_FILL:
 		if (strcmp(value, "none") == 0) {
 			attr->hasFill = 0;
 		} else if (strncmp(value, "url(", 4) == 0) {
@@ -1774,11 +2271,14 @@ static int nsvg__parseAttr(NSVGparser* p, const char* name, const char* value)
 			attr->hasFill = 1;
 			attr->fillColor = nsvg__parseColor(value);
 		}
-	} else if (strcmp(name, "opacity") == 0) {
+		break;
+	case NSVG_ATTR_OPACITY:
 		attr->opacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "fill-opacity") == 0) {
+		break;
+	case NSVG_ATTR_FILL_OPACITY:
 		attr->fillOpacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "stroke") == 0) {
+		break;
+	case NSVG_ATTR_STROKE:
 		if (strcmp(value, "none") == 0) {
 			attr->hasStroke = 0;
 		} else if (strncmp(value, "url(", 4) == 0) {
@@ -1788,42 +2288,62 @@ static int nsvg__parseAttr(NSVGparser* p, const char* name, const char* value)
 			attr->hasStroke = 1;
 			attr->strokeColor = nsvg__parseColor(value);
 		}
-	} else if (strcmp(name, "stroke-width") == 0) {
+		break;
+	case NSVG_ATTR_STROKE_WIDTH:
 		attr->strokeWidth = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
-	} else if (strcmp(name, "stroke-dasharray") == 0) {
+		break;
+	case NSVG_ATTR_STROKE_DASHARRAY:
 		attr->strokeDashCount = nsvg__parseStrokeDashArray(p, value, attr->strokeDashArray);
-	} else if (strcmp(name, "stroke-dashoffset") == 0) {
+		break;
+	case NSVG_ATTR_STROKE_DASHOFFSET:
 		attr->strokeDashOffset = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
-	} else if (strcmp(name, "stroke-opacity") == 0) {
+		break;
+	case NSVG_ATTR_STROKE_OPACITY:
 		attr->strokeOpacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "stroke-linecap") == 0) {
+		break;
+	case NSVG_ATTR_STROKE_LINECAP:
 		attr->strokeLineCap = nsvg__parseLineCap(value);
-	} else if (strcmp(name, "stroke-linejoin") == 0) {
+		break;
+	case NSVG_ATTR_STROKE_LINEJOIN:
 		attr->strokeLineJoin = nsvg__parseLineJoin(value);
-	} else if (strcmp(name, "stroke-miterlimit") == 0) {
+		break;
+	case NSVG_ATTR_STROKE_MITERLIMIT:
 		attr->miterLimit = nsvg__parseMiterLimit(value);
-	} else if (strcmp(name, "fill-rule") == 0) {
+		break;
+	case NSVG_ATTR_FILL_RULE:
 		attr->fillRule = nsvg__parseFillRule(value);
-	} else if (strcmp(name, "font-size") == 0) {
+		break;
+	case NSVG_ATTR_FONT_SIZE:
 		attr->fontSize = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
-	} else if (strcmp(name, "transform") == 0) {
+		break;
+	case NSVG_ATTR_TRANSFORM:
 		nsvg__parseTransform(xform, value);
 		nsvg__xformPremultiply(attr->xform, xform);
-	} else if (strcmp(name, "stop-color") == 0) {
+		break;
+	case NSVG_ATTR_STOP_COLOR:
 		attr->stopColor = nsvg__parseColor(value);
-	} else if (strcmp(name, "stop-opacity") == 0) {
+		break;
+	case NSVG_ATTR_STOP_OPACITY:
 		attr->stopOpacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "offset") == 0) {
+		break;
+	case NSVG_ATTR_OFFSET:
 		attr->stopOffset = nsvg__parseCoordinate(p, value, 0.0f, 1.0f);
-	} else if (strcmp(name, "id") == 0) {
+		break;
+	case NSVG_ATTR_ID:
 		strncpy(attr->id, value, 63);
 		attr->id[63] = '\0';
-	} else {
+		break;
+	default:
 		return 0;
 	}
 	return 1;
 }
 
+static int nsvg__parseAttr(NSVGparser* p, const char* name, const char* value)
+{
+	return nsvg__parseAttrId(p, nsvg__attrId(name), value);
+}
+
 static int nsvg__parseNameValue(NSVGparser* p, const char* start, const char* end)
 {
 	const char* str;
@@ -1877,30 +2397,37 @@ static void nsvg__parseStyle(NSVGparser* p, const char* str)
 	}
 }
 
+// Parses the attribute id of a group, font or font-face element.
+static void nsvg__parseAttribId(NSVGparser* p, int id, const char* value)
+{
+	char *end;
+	switch (id) {
+	case NSVG_ATTR_HORIZ_ADV_X:
+		p->image->defaultHorizAdv = strtol(value, &end, 10);
+		if (end == value)
+			p->image->defaultHorizAdv = 0;
+		break;
+	case NSVG_ATTR_ASCENT:
+		p->image->fontAscent = strtol(value, &end, 10);
+		if (end == value)
+			p->image->fontAscent = 0;
+		break;
+	case NSVG_ATTR_DESCENT:
+		p->image->fontDescent = strtol(value, &end, 10);
+		if (end == value)
+			p->image->fontDescent = 0;
+		break;
+	default:
+		nsvg__parseAttrId(p, id, value);
+		break;
+	}
+}
+
 static void nsvg__parseAttribs(NSVGparser* p, const char** attr)
 {
 	int i;
-	char *end;
 	for (i = 0; attr[i]; i += 2)
-	{
-		if (strcmp(attr[i], "style") == 0) {
-			nsvg__parseStyle(p, attr[i + 1]);
-		} else if (strcmp(attr[i], "horiz-adv-x") == 0) {
-			p->image->defaultHorizAdv = strtol(attr[i+1], &end, 10);
-			if (end == attr[i+1])
-				p->image->defaultHorizAdv = 0;
-		} else if (strcmp(attr[i], "ascent") == 0) {
-			p->image->fontAscent = strtol(attr[i+1], &end, 10);
-			if (end == attr[i+1])
-				p->image->fontAscent = 0;
-		} else if (strcmp(attr[i], "descent") == 0) {
-			p->image->fontDescent = strtol(attr[i+1], &end, 10);
-			if (end == attr[i+1])
-				p->image->fontDescent = 0;
-		} else {
-			nsvg__parseAttr(p, attr[i], attr[i + 1]);
-		}
-	}
+		nsvg__parseAttribId(p, nsvg__attrId(attr[i]), attr[i + 1]);
 }
 
 static int nsvg__getArgsPerElement(char cmd)
@@ -2241,6 +2768,154 @@ static void nsvg__pathArcTo(NSVGparser* p, float* cpx, float* cpy, float* args,
 	*cpy = y2;
 }
 
+// Decodes the UTF-8 character at s, returns its length in bytes. Bytes
+// that don't start a valid sequence are taken as Latin-1.
+static int nsvg__decodeUTF8(const char* s, int len, unsigned int* codepoint)
+{
+	const unsigned char* u = (const unsigned char*)s;
+	int i, n;
+
+	if (u[0] < 0x80) {
+		*codepoint = u[0];
+		return 1;
+	} else if ((u[0] & 0xe0) == 0xc0) {
+		*codepoint = u[0] & 0x1f;
+		n = 2;
+	} else if ((u[0] & 0xf0) == 0xe0) {
+		*codepoint = u[0] & 0x0f;
+		n = 3;
+	} else if ((u[0] & 0xf8) == 0xf0) {
+		*codepoint = u[0] & 0x07;
+		n = 4;
+	} else {
+		*codepoint = u[0];
+		return 1;
+	}
+
+	if (n > len) {
+		*codepoint = u[0];
+		return 1;
+	}
+	for (i = 1; i < n; i++) {
+		if ((u[i] & 0xc0) != 0x80) {
+			*codepoint = u[0];
+			return 1;
+		}
+		*codepoint = (*codepoint << 6) | (u[i] & 0x3f);
+	}
+
+	return n;
+}
+
+static int nsvg__encodeUTF8(char* s, unsigned int codepoint)
+{
+	if (codepoint < 0x80) {
+		s[0] = (char)codepoint;
+		return 1;
+	} else if (codepoint < 0x800) {
+		s[0] = (char)(0xc0 | (codepoint >> 6));
+		s[1] = (char)(0x80 | (codepoint & 0x3f));
+		return 2;
+	} else if (codepoint < 0x10000) {
+		s[0] = (char)(0xe0 | (codepoint >> 12));
+		s[1] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+		s[2] = (char)(0x80 | (codepoint & 0x3f));
+		return 3;
+	}
+	s[0] = (char)(0xf0 | (codepoint >> 18));
+	s[1] = (char)(0x80 | ((codepoint >> 12) & 0x3f));
+	s[2] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+	s[3] = (char)(0x80 | (codepoint & 0x3f));
+	return 4;
+}
+
+// Replaces XML character and predefined entity references in src. The
+// result is never longer than src, unknown references are copied as is.
+static void nsvg__decodeEntities(char* dst, const char* src)
+{
+	static const char* names[] = { "amp;", "lt;", "gt;", "quot;", "apos;" };
+	static const char chars[] = { '&', '<', '>', '"', '\'' };
+	unsigned long codepoint;
+	char* end;
+	int i;
+
+	while (*src) {
+		if (*src != '&') {
+			*dst++ = *src++;
+			continue;
+		}
+		if (src[1] == '#') {
+			if (src[2] == 'x' || src[2] == 'X')
+				codepoint = strtoul(src + 3, &end, 16);
+			else
+				codepoint = strtoul(src + 2, &end, 10);
+			if (*end == ';' && end > src + 2 && codepoint > 0 && codepoint <= 0x10ffff) {
+				dst += nsvg__encodeUTF8(dst, (unsigned int)codepoint);
+				src = end + 1;
+				continue;
+			}
+		} else {
+			for (i = 0; i < 5; i++) {
+				if (strncmp(src + 1, names[i], strlen(names[i])) == 0)
+					break;
+			}
+			if (i < 5) {
+				*dst++ = chars[i];
+				src += 1 + strlen(names[i]);
+				continue;
+			}
+		}
+		*dst++ = *src++;
+	}
+	*dst = '\0';
+}
+
+static int nsvg__cmpCodepoint(const void* a, const void* b)
+{
+	unsigned int ca = *(const unsigned int*)a, cb = *(const unsigned int*)b;
+	return ca < cb ? -1 : ca > cb;
+}
+
+static int nsvg__setGlyphFilter(NSVGparser* p, const char* chars)
+{
+	int i, n, len = strlen(chars);
+
+	p->glyphFilter = (unsigned int*)malloc(sizeof(unsigned int) * (len + 1));
+	if (p->glyphFilter == NULL) return 0;
+
+	for (i = 0, n = 0; i < len; n++)
+		i += nsvg__decodeUTF8(&chars[i], len - i, &p->glyphFilter[n]);
+	qsort(p->glyphFilter, n, sizeof(unsigned int), nsvg__cmpCodepoint);
+
+	// Drop duplicates
+	p->nglyphFilter = 0;
+	for (i = 0; i < n; i++) {
+		if (p->nglyphFilter == 0 || p->glyphFilter[p->nglyphFilter-1] != p->glyphFilter[i])
+			p->glyphFilter[p->nglyphFilter++] = p->glyphFilter[i];
+	}
+
+	return 1;
+}
+
+// Whether the glyph filter keeps the glyph for unicode, which it does if
+// it has every character of unicode
+static int nsvg__wantGlyph(NSVGparser* p, const char* unicode)
+{
+	unsigned int codepoint;
+	int i, len = strlen(unicode);
+
+	if (p->glyphFilter == NULL)
+		return 1;
+
+	for (i = 0; i < len; ) {
+		i += nsvg__decodeUTF8(&unicode[i], len - i, &codepoint);
+		if (bsearch(&codepoint, p->glyphFilter, p->nglyphFilter, sizeof(unsigned int), nsvg__cmpCodepoint) == NULL)
+			return 0;
+	}
+
+	return 1;
+}
+
 static void nsvg__parsePath(NSVGparser* p, const char** attr)
 {
 	const char* s = NULL;
@@ -2250,28 +2925,31 @@ static void nsvg__parsePath(NSVGparser* p, const char** attr)
 	int rargs = 0;
 	char initPoint;
 	float cpx, cpy, cpx2, cpy2;
-	const char* tmp[4];
 	char closedFlag;
-	int i;
+	int i, id;
 	char item[64];
 
 	for (i = 0; attr[i]; i += 2) {
-		if (strcmp(attr[i], "d") == 0) {
+		id = nsvg__attrId(attr[i]);
+		if (id == NSVG_ATTR_D) {
 			s = attr[i + 1];
-		} else if (strcmp(attr[i], "unicode") == 0
-				&& strlen(attr[i+1]) < NSVG_MAX_UNICODE_LEN) {
-			strcpy(p->unicodeFlag, attr[i+1]);
-		} else if (strcmp(attr[i], "horiz-adv-x") == 0) {
-			p->horizAdvFlag = attr[i+1];
+		} else if (id == NSVG_ATTR_UNICODE) {
+			if (strlen(attr[i+1]) < NSVG_MAX_UNICODE_LEN)
+				nsvg__decodeEntities(p->unicodeFlag, attr[i+1]);
+		} else if (id == NSVG_ATTR_HORIZ_ADV_X) {
+			// Parsed now, the input may be gone by the time the glyph is added
+			p->horizAdvFlag = (int)strtol(attr[i+1], NULL, 10);
 		} else {
-			tmp[0] = attr[i];
-			tmp[1] = attr[i + 1];
-			tmp[2] = 0;
-			tmp[3] = 0;
-			nsvg__parseAttribs(p, tmp);
+			nsvg__parseAttribId(p, id, attr[i + 1]);
 		}
 	}
 
+	// Don't bother with the outlines of glyphs nobody will draw
+	if (s && p->unicodeFlag[0] && !nsvg__wantGlyph(p, p->unicodeFlag)) {
+		nsvg__addGlyphStub(p);
+		return;
+	}
+
 	if (s) {
 		nsvg__resetPath(p);
 		cpx = 0; cpy = 0;
@@ -2398,16 +3076,17 @@ static void nsvg__parseRect(NSVGparser* p, const char** attr)
 	float h = 0.0f;
 	float rx = -1.0f; // marks not set
 	float ry = -1.0f;
-	int i;
+	int i, id;
 
 	for (i = 0; attr[i]; i += 2) {
-		if (!nsvg__parseAttr(p, attr[i], attr[i + 1])) {
-			if (strcmp(attr[i], "x") == 0) x = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
-			if (strcmp(attr[i], "y") == 0) y = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
-			if (strcmp(attr[i], "width") == 0) w = nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualWidth(p));
-			if (strcmp(attr[i], "height") == 0) h = nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualHeight(p));
-			if (strcmp(attr[i], "rx") == 0) rx = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualWidth(p)));
-			if (strcmp(attr[i], "ry") == 0) ry = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualHeight(p)));
+		id = nsvg__attrId(attr[i]);
+		if (!nsvg__parseAttrId(p, id, attr[i + 1])) {
+			if (id == NSVG_ATTR_X) x = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
+			if (id == NSVG_ATTR_Y) y = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
+			if (id == NSVG_ATTR_WIDTH) w = nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualWidth(p));
+			if (id == NSVG_ATTR_HEIGHT) h = nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualHeight(p));
+			if (id == NSVG_ATTR_RX) rx = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualWidth(p)));
+			if (id == NSVG_ATTR_RY) ry = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualHeight(p)));
 		}
 	}
 
@@ -2450,13 +3129,14 @@ static void nsvg__parseCircle(NSVGparser* p, const char** attr)
 	float cx = 0.0f;
 	float cy = 0.0f;
 	float r = 0.0f;
-	int i;
+	int i, id;
 
 	for (i = 0; attr[i]; i += 2) {
-		if (!nsvg__parseAttr(p, attr[i], attr[i + 1])) {
-			if (strcmp(attr[i], "cx") == 0) cx = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
-			if (strcmp(attr[i], "cy") == 0) cy = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
-			if (strcmp(attr[i], "r") == 0) r = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualLength(p)));
+		id = nsvg__attrId(attr[i]);
+		if (!nsvg__parseAttrId(p, id, attr[i + 1])) {
+			if (id == NSVG_ATTR_CX) cx = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
+			if (id == NSVG_ATTR_CY) cy = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
+			if (id == NSVG_ATTR_R) r = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualLength(p)));
 		}
 	}
 
@@ -2481,14 +3161,15 @@ static void nsvg__parseEllipse(NSVGparser* p, const char** attr)
 	float cy = 0.0f;
 	float rx = 0.0f;
 	float ry = 0.0f;
-	int i;
+	int i, id;
 
 	for (i = 0; attr[i]; i += 2) {
-		if (!nsvg__parseAttr(p, attr[i], attr[i + 1])) {
-			if (strcmp(attr[i], "cx") == 0) cx = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
-			if (strcmp(attr[i], "cy") == 0) cy = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
-			if (strcmp(attr[i], "rx") == 0) rx = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualWidth(p)));
-			if (strcmp(attr[i], "ry") == 0) ry = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualHeight(p)));
+		id = nsvg__attrId(attr[i]);
+		if (!nsvg__parseAttrId(p, id, attr[i + 1])) {
+			if (id == NSVG_ATTR_CX) cx = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
+			if (id == NSVG_ATTR_CY) cy = nsvg__parseCoordinate(p, attr[i+1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
+			if (id == NSVG_ATTR_RX) rx = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualWidth(p)));
+			if (id == NSVG_ATTR_RY) ry = fabsf(nsvg__parseCoordinate(p, attr[i+1], 0.0f, nsvg__actualHeight(p)));
 		}
 	}
 
@@ -2514,14 +3195,15 @@ static void nsvg__parseLine(NSVGparser* p, const char** attr)
 	float y1 = 0.0;
 	float x2 = 0.0;
 	float y2 = 0.0;
-	int i;
+	int i, id;
 
 	for (i = 0; attr[i]; i += 2) {
-		if (!nsvg__parseAttr(p, attr[i], attr[i + 1])) {
-			if (strcmp(attr[i], "x1") == 0) x1 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
-			if (strcmp(attr[i], "y1") == 0) y1 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
-			if (strcmp(attr[i], "x2") == 0) x2 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
-			if (strcmp(attr[i], "y2") == 0) y2 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
+		id = nsvg__attrId(attr[i]);
+		if (!nsvg__parseAttrId(p, id, attr[i + 1])) {
+			if (id == NSVG_ATTR_X1) x1 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
+			if (id == NSVG_ATTR_Y1) y1 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
+			if (id == NSVG_ATTR_X2) x2 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigX(p), nsvg__actualWidth(p));
+			if (id == NSVG_ATTR_Y2) y2 = nsvg__parseCoordinate(p, attr[i + 1], nsvg__actualOrigY(p), nsvg__actualHeight(p));
 		}
 	}
 
@@ -2537,7 +3219,7 @@ static void nsvg__parseLine(NSVGparser* p, const char** attr)
 
 static void nsvg__parsePoly(NSVGparser* p, const char** attr, int closeFlag)
 {
-	int i;
+	int i, id;
 	const char* s;
 	float args[2];
 	int nargs, npts = 0;
@@ -2546,8 +3228,9 @@ static void nsvg__parsePoly(NSVGparser* p, const char** attr, int closeFlag)
 	nsvg__resetPath(p);
 
 	for (i = 0; attr[i]; i += 2) {
-		if (!nsvg__parseAttr(p, attr[i], attr[i + 1])) {
-			if (strcmp(attr[i], "points") == 0) {
+		id = nsvg__attrId(attr[i]);
+		if (!nsvg__parseAttrId(p, id, attr[i + 1])) {
+			if (id == NSVG_ATTR_POINTS) {
 				s = attr[i + 1];
 				nargs = 0;
 				while (*s) {
@@ -2573,14 +3256,15 @@ static void nsvg__parsePoly(NSVGparser* p, const char** attr, int closeFlag)
 
 static void nsvg__parseSVG(NSVGparser* p, const char** attr)
 {
-	int i;
+	int i, id;
 	for (i = 0; attr[i]; i += 2) {
-		if (!nsvg__parseAttr(p, attr[i], attr[i + 1])) {
-			if (strcmp(attr[i], "width") == 0) {
+		id = nsvg__attrId(attr[i]);
+		if (!nsvg__parseAttrId(p, id, attr[i + 1])) {
+			if (id == NSVG_ATTR_WIDTH) {
 				p->image->width = nsvg__parseCoordinate(p, attr[i + 1], 0.0f, 0.0f);
-			} else if (strcmp(attr[i], "height") == 0) {
+			} else if (id == NSVG_ATTR_HEIGHT) {
 				p->image->height = nsvg__parseCoordinate(p, attr[i + 1], 0.0f, 0.0f);
-			} else if (strcmp(attr[i], "viewBox") == 0) {
+			} else if (id == NSVG_ATTR_VIEW_BOX) {
 				const char *s = attr[i + 1];
 				char buf[64];
 				s = nsvg__parseNumber(s, buf, 64);
@@ -2597,7 +3281,7 @@ static void nsvg__parseSVG(NSVGparser* p, const char** attr)
 				if (!*s) return;
 				s = nsvg__parseNumber(s, buf, 64);
 				p->viewHeight = nsvg__atof(buf);
-			} else if (strcmp(attr[i], "preserveAspectRatio") == 0) {
+			} else if (id == NSVG_ATTR_PRESERVE_ASPECT_RATIO) {
 				if (strstr(attr[i + 1], "none") != 0) {
 					// No uniform scaling
 					p->alignType = NSVG_ALIGN_NONE;
@@ -2628,7 +3312,7 @@ static void nsvg__parseSVG(NSVGparser* p, const char** attr)
 
 static void nsvg__parseGradient(NSVGparser* p, const char** attr, char type)
 {
-	int i;
+	int i, id;
 	NSVGgradientData* grad = (NSVGgradientData*)malloc(sizeof(NSVGgradientData));
 	if (grad == NULL) return;
 	memset(grad, 0, sizeof(NSVGgradientData));
@@ -2648,43 +3332,44 @@ static void nsvg__parseGradient(NSVGparser* p, const char** attr, char type)
 	nsvg__xformIdentity(grad->xform);
 
 	for (i = 0; attr[i]; i += 2) {
-		if (strcmp(attr[i], "id") == 0) {
+		id = nsvg__attrId(attr[i]);
+		if (id == NSVG_ATTR_ID) {
 			strncpy(grad->id, attr[i+1], 63);
 			grad->id[63] = '\0';
-		} else if (!nsvg__parseAttr(p, attr[i], attr[i + 1])) {
-			if (strcmp(attr[i], "gradientUnits") == 0) {
+		} else if (!nsvg__parseAttrId(p, id, attr[i + 1])) {
+			if (id == NSVG_ATTR_GRADIENT_UNITS) {
 				if (strcmp(attr[i+1], "objectBoundingBox") == 0)
 					grad->units = NSVG_OBJECT_SPACE;
 				else
 					grad->units = NSVG_USER_SPACE;
-			} else if (strcmp(attr[i], "gradientTransform") == 0) {
+			} else if (id == NSVG_ATTR_GRADIENT_TRANSFORM) {
 				nsvg__parseTransform(grad->xform, attr[i + 1]);
-			} else if (strcmp(attr[i], "cx") == 0) {
+			} else if (id == NSVG_ATTR_CX) {
 				grad->radial.cx = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "cy") == 0) {
+			} else if (id == NSVG_ATTR_CY) {
 				grad->radial.cy = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "r") == 0) {
+			} else if (id == NSVG_ATTR_R) {
 				grad->radial.r = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "fx") == 0) {
+			} else if (id == NSVG_ATTR_FX) {
 				grad->radial.fx = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "fy") == 0) {
+			} else if (id == NSVG_ATTR_FY) {
 				grad->radial.fy = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "x1") == 0) {
+			} else if (id == NSVG_ATTR_X1) {
 				grad->linear.x1 = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "y1") == 0) {
+			} else if (id == NSVG_ATTR_Y1) {
 				grad->linear.y1 = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "x2") == 0) {
+			} else if (id == NSVG_ATTR_X2) {
 				grad->linear.x2 = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "y2") == 0) {
+			} else if (id == NSVG_ATTR_Y2) {
 				grad->linear.y2 = nsvg__parseCoordinateRaw(attr[i + 1]);
-			} else if (strcmp(attr[i], "spreadMethod") == 0) {
+			} else if (id == NSVG_ATTR_SPREAD_METHOD) {
 				if (strcmp(attr[i+1], "pad") == 0)
 					grad->spread = NSVG_SPREAD_PAD;
 				else if (strcmp(attr[i+1], "reflect") == 0)
 					grad->spread = NSVG_SPREAD_REFLECT;
 				else if (strcmp(attr[i+1], "repeat") == 0)
 					grad->spread = NSVG_SPREAD_REPEAT;
-			} else if (strcmp(attr[i], "xlink:href") == 0) {
+			} else if (id == NSVG_ATTR_XLINK_HREF) {
 				const char *href = attr[i+1];
 				strncpy(grad->ref, href+1, 62);
 				grad->ref[62] = '\0';
@@ -2741,74 +3426,93 @@ static void nsvg__parseGradientStop(NSVGparser* p, const char** attr)
 static void nsvg__startElement(void* ud, const char* el, const char** attr)
 {
 	NSVGparser* p = (NSVGparser*)ud;
+	int id = nsvg__elementId(el);
 
 	if (p->defsFlag) {
 		// Skip everything but gradients and fonts in defs
-		if (strcmp(el, "linearGradient") == 0) {
+		switch (id) {
+		case NSVG_ELEMENT_LINEAR_GRADIENT:
 			nsvg__parseGradient(p, attr, NSVG_PAINT_LINEAR_GRADIENT);
-		} else if (strcmp(el, "radialGradient") == 0) {
+			break;
+		case NSVG_ELEMENT_RADIAL_GRADIENT:
 			nsvg__parseGradient(p, attr, NSVG_PAINT_RADIAL_GRADIENT);
-		} else if (strcmp(el, "stop") == 0) {
+			break;
+		case NSVG_ELEMENT_STOP:
 			nsvg__parseGradientStop(p, attr);
-		} else if (strcmp(el, "glyph") == 0) { // glyphs are just special paths
+			break;
+		case NSVG_ELEMENT_GLYPH: // glyphs are just special paths
 			if (p->pathFlag)	// Do not allow nested paths.
 				return;
 			nsvg__pushAttr(p);
 			nsvg__parsePath(p, attr);
 			nsvg__popAttr(p);
-		} else if (strcmp(el, "font") == 0) { // fonts are special "g" tags
-			nsvg__pushAttr(p);
-			nsvg__parseAttribs(p, attr);
-		} else if (strcmp(el, "font-face") == 0) { // for the default character width
+			break;
+		case NSVG_ELEMENT_FONT: // fonts are special "g" tags
+		case NSVG_ELEMENT_FONT_FACE: // for the default character width
 			nsvg__pushAttr(p);
 			nsvg__parseAttribs(p, attr);
+			break;
 		}
 		return;
 	}
 
-	if (strcmp(el, "g") == 0) {
+	switch (id) {
+	case NSVG_ELEMENT_G:
 		nsvg__pushAttr(p);
 		nsvg__parseAttribs(p, attr);
-	} else if (strcmp(el, "path") == 0) {
+		break;
+	case NSVG_ELEMENT_PATH:
 		if (p->pathFlag)	// Do not allow nested paths.
 			return;
 		nsvg__pushAttr(p);
 		nsvg__parsePath(p, attr);
 		nsvg__popAttr(p);
-	} else if (strcmp(el, "rect") == 0) {
+		break;
+	case NSVG_ELEMENT_RECT:
 		nsvg__pushAttr(p);
 		nsvg__parseRect(p, attr);
 		nsvg__popAttr(p);
-	} else if (strcmp(el, "circle") == 0) {
+		break;
+	case NSVG_ELEMENT_CIRCLE:
 		nsvg__pushAttr(p);
 		nsvg__parseCircle(p, attr);
 		nsvg__popAttr(p);
-	} else if (strcmp(el, "ellipse") == 0) {
+		break;
+	case NSVG_ELEMENT_ELLIPSE:
 		nsvg__pushAttr(p);
 		nsvg__parseEllipse(p, attr);
 		nsvg__popAttr(p);
-	} else if (strcmp(el, "line") == 0)  {
+		break;
+	case NSVG_ELEMENT_LINE:
 		nsvg__pushAttr(p);
 		nsvg__parseLine(p, attr);
 		nsvg__popAttr(p);
-	} else if (strcmp(el, "polyline") == 0)  {
+		break;
+	case NSVG_ELEMENT_POLYLINE:
 		nsvg__pushAttr(p);
 		nsvg__parsePoly(p, attr, 0);
 		nsvg__popAttr(p);
-	} else if (strcmp(el, "polygon") == 0)  {
+		break;
+	case NSVG_ELEMENT_POLYGON:
 		nsvg__pushAttr(p);
 		nsvg__parsePoly(p, attr, 1);
 		nsvg__popAttr(p);
-	} else  if (strcmp(el, "linearGradient") == 0) {
+		break;
+	case NSVG_ELEMENT_LINEAR_GRADIENT:
 		nsvg__parseGradient(p, attr, NSVG_PAINT_LINEAR_GRADIENT);
-	} else if (strcmp(el, "radialGradient") == 0) {
+		break;
+	case NSVG_ELEMENT_RADIAL_GRADIENT:
 		nsvg__parseGradient(p, attr, NSVG_PAINT_RADIAL_GRADIENT);
-	} else if (strcmp(el, "stop") == 0) {
+		break;
+	case NSVG_ELEMENT_STOP:
 		nsvg__parseGradientStop(p, attr);
-	} else if (strcmp(el, "defs") == 0) {
+		break;
+	case NSVG_ELEMENT_DEFS:
 		p->defsFlag = 1;
-	} else if (strcmp(el, "svg") == 0) {
+		break;
+	case NSVG_ELEMENT_SVG:
 		nsvg__parseSVG(p, attr);
+		break;
 	}
 }
 
@@ -2816,12 +3520,16 @@ static void nsvg__endElement(void* ud, const char* el)
 {
 	NSVGparser* p = (NSVGparser*)ud;
 
-	if (strcmp(el, "g") == 0) {
+	switch (nsvg__elementId(el)) {
+	case NSVG_ELEMENT_G:
 		nsvg__popAttr(p);
-	} else if (strcmp(el, "path") == 0) {
+		break;
+	case NSVG_ELEMENT_PATH:
 		p->pathFlag = 0;
-	} else if (strcmp(el, "defs") == 0) {
+		break;
+	case NSVG_ELEMENT_DEFS:
 		p->defsFlag = 0;
+		break;
 	}
 }
 
@@ -2880,8 +3588,17 @@ static void nsvg__scaleToViewbox(NSVGparser* p, const char* units)
 	int i;
 	float* pt;
 
-	// Guess image size if not set completely.
-	nsvg__imageBounds(p, bounds);
+	// Guess image size if not set completely. For fonts that is the em box
+	// rather than the bounds of all glyphs, so where glyphs end up doesn't
+	// depend on which glyphs a font has, or which of them were parsed.
+	if (p->image->fontAscent > p->image->fontDescent) {
+		bounds[0] = 0;
+		bounds[1] = (float)p->image->fontDescent;
+		bounds[2] = (float)p->image->defaultHorizAdv;
+		bounds[3] = (float)p->image->fontAscent;
+	} else {
+		nsvg__imageBounds(p, bounds);
+	}
 
 	if (p->viewWidth == 0) {
 		if (p->image->width > 0) {
@@ -2963,50 +3680,171 @@ static void nsvg__scaleToViewbox(NSVGparser* p, const char* units)
 	}
 }
 
+static unsigned int nsvg__hashCodepoint(unsigned int codepoint)
+{
+	return codepoint * 2654435761u;
+}
+
+// Returns the slot holding codepoint, or the free slot it would go in
+static NSVGglyphEntry* nsvg__glyphSlot(const NSVGimage* image, unsigned int codepoint)
+{
+	unsigned int slot = nsvg__hashCodepoint(codepoint) & (image->glyphHashSize - 1);
+
+	while (image->glyphHash[slot].shape != NULL && image->glyphHash[slot].codepoint != codepoint)
+		slot = (slot + 1) & (image->glyphHashSize - 1);
+	return &image->glyphHash[slot];
+}
+
+// Adds shape to the chain of glyphs starting with the same character,
+// which is kept ordered longest unicode first so lookups find the longest
+// ligature. If several glyphs have the same unicode, the first one wins.
+static void nsvg__addGlyph(NSVGshape** chain, NSVGshape* shape)
+{
+	int len = strlen(shape->unicode);
+	NSVGshape* other;
+
+	while (*chain != NULL && (int)strlen((*chain)->unicode) > len)
+		chain = &(*chain)->nextGlyph;
+	for (other = *chain; other != NULL && (int)strlen(other->unicode) == len; other = other->nextGlyph) {
+		if (strcmp(other->unicode, shape->unicode) == 0)
+			return;
+	}
+	shape->nextGlyph = *chain;
+	*chain = shape;
+}
+
+// Indexes the glyphs of a font by the first codepoint of their unicode
+static void nsvg__buildGlyphTable(NSVGimage* image)
+{
+	NSVGglyphEntry* entry;
+	NSVGshape* shape;
+	unsigned int codepoint;
+	int count = 0;
+
+	for (shape = image->shapes; shape != NULL; shape = shape->next) {
+		if (!(shape->flags & NSVG_FLAGS_VISIBLE) || shape->unicode[0] == '\0')
+			continue;
+		nsvg__decodeUTF8(shape->unicode, strlen(shape->unicode), &codepoint);
+		if (codepoint < 256)
+			nsvg__addGlyph(&image->latin1Glyphs[codepoint], shape);
+		else
+			count++;
+	}
+
+	if (count == 0)
+		return;
+
+	// Keep the table at most half full
+	image->glyphHashSize = 1;
+	while (image->glyphHashSize < count * 2)
+		image->glyphHashSize *= 2;
+	image->glyphHash = (NSVGglyphEntry*)nsvg__arenaAlloc(&image->arena, image->glyphHashSize * sizeof(NSVGglyphEntry));
+	if (image->glyphHash == NULL) {
+		image->glyphHashSize = 0;
+		return;
+	}
+	memset(image->glyphHash, 0, image->glyphHashSize * sizeof(NSVGglyphEntry));
+
+	for (shape = image->shapes; shape != NULL; shape = shape->next) {
+		if (!(shape->flags & NSVG_FLAGS_VISIBLE) || shape->unicode[0] == '\0')
+			continue;
+		nsvg__decodeUTF8(shape->unicode, strlen(shape->unicode), &codepoint);
+		if (codepoint < 256)
+			continue;
+		entry = nsvg__glyphSlot(image, codepoint);
+		entry->codepoint = codepoint;
+		nsvg__addGlyph(&entry->shape, shape);
+	}
+}
+
+// Returns the chain of glyphs starting with codepoint
+static NSVGshape* nsvg__glyphChain(const NSVGimage* image, unsigned int codepoint)
+{
+	if (codepoint < 256)
+		return image->latin1Glyphs[codepoint];
+	if (image->glyphHashSize == 0)
+		return NULL;
+	return nsvg__glyphSlot(image, codepoint)->shape;
+}
+
+NSVGshape* nsvgGetGlyph(const NSVGimage* image, unsigned int codepoint)
+{
+	NSVGshape* shape;
+	unsigned int c;
+
+	// The single character glyph comes last, after any ligatures
+	for (shape = nsvg__glyphChain(image, codepoint); shape != NULL; shape = shape->nextGlyph) {
+		if (shape->unicode[nsvg__decodeUTF8(shape->unicode, strlen(shape->unicode), &c)] == '\0')
+			return shape;
+	}
+
+	return NULL;
+}
+
+NSVGshape* nsvgGetTextGlyph(const NSVGimage* image, const char* s, int len, int* glyphLen)
+{
+	NSVGshape* shape;
+	unsigned int codepoint;
+	int n;
+
+	*glyphLen = nsvg__decodeUTF8(s, len, &codepoint);
+	for (shape = nsvg__glyphChain(image, codepoint); shape != NULL; shape = shape->nextGlyph) {
+		n = strlen(shape->unicode);
+		if (n <= len && strncmp(shape->unicode, s, n) == 0) {
+			*glyphLen = n;
+			return shape;
+		}
+	}
+
+	return NULL;
+}
+
 NSVGshape** nsvgGetTextShapes(const NSVGimage* image, const char* text, int textLen)
 {
-	NSVGshape *shape = NULL;
-	NSVGshape **ret = calloc(textLen, sizeof(shape)); // array of paths, text to render
-	int i;
+	NSVGshape **ret = calloc(textLen, sizeof(NSVGshape*)); // array of paths, text to render
+	int i, n;
+
+	if (ret == NULL)
+		return NULL;
 
 	// make list of paths representing glyphs to render
-	for (i = 0; i < textLen; i++)
-	{
+	for (i = 0; i < textLen; i += n) {
 		if (text[i] == ' ' || text[i] == '\n') {
-			ret[i] = NULL;
+			n = 1;
 			continue;
 		}
-		for (shape = image->shapes; shape != NULL; shape = shape->next) {
-			if (!(shape->flags & NSVG_FLAGS_VISIBLE))
-				continue;
-			if (shape->unicode[0] == text[i]) {
-				ret[i] = shape;
-				goto found;
-			}
-		}
-found:
-		continue;
+		ret[i] = nsvgGetTextGlyph(image, &text[i], textLen - i, &n);
 	}
 
 	return ret;
 }
 
-NSVGimage* nsvgParse(char* input, const char* units, float dpi)
+static NSVGparser* nsvg__startParse(float dpi, const char* chars)
 {
 	NSVGparser* p;
-	NSVGimage* ret = 0;
 
 	p = nsvg__createParser();
 	if (p == NULL) {
 		return NULL;
 	}
 	p->dpi = dpi;
+	if (chars != NULL && !nsvg__setGlyphFilter(p, chars)) {
+		nsvg__deleteParser(p);
+		return NULL;
+	}
 
-	nsvg__parseXML(input, nsvg__startElement, nsvg__endElement, nsvg__content, p);
+	return p;
+}
+
+static NSVGimage* nsvg__endParse(NSVGparser* p, const char* units)
+{
+	NSVGimage* ret = 0;
 
 	// Scale to viewBox
 	nsvg__scaleToViewbox(p, units);
 
+	nsvg__buildGlyphTable(p->image);
+
 	ret = p->image;
 	p->image = NULL;
 
@@ -3015,13 +3853,98 @@ NSVGimage* nsvgParse(char* input, const char* units, float dpi)
 	return ret;
 }
 
-NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi)
+static NSVGimage* nsvg__parse(char* input, const char* units, float dpi, const char* chars)
+{
+	NSVGparser* p;
+
+	p = nsvg__startParse(dpi, chars);
+	if (p == NULL) {
+		return NULL;
+	}
+
+	nsvg__parseXML(input, nsvg__startElement, nsvg__endElement, nsvg__content, p);
+
+	return nsvg__endParse(p, units);
+}
+
+NSVGimage* nsvgParse(char* input, const char* units, float dpi)
+{
+	return nsvg__parse(input, units, dpi, NULL);
+}
+
+NSVGimage* nsvgParseFont(char* input, const char* units, float dpi, const char* chars)
+{
+	return nsvg__parse(input, units, dpi, chars);
+}
+
+#ifdef NSVG_HAVE_MMAP
+// Maps a regular file copy on write, so the parser can modify it in place
+// straight from the page cache. The mapping is followed by at least one
+// zero byte: the rest of the last page is zero filled, and if the file
+// ends on a page boundary an anonymous page after it provides the
+// terminator. Returns NULL if the file can't be mapped, or is small
+// enough that setting up the mapping costs more than reading it.
+#define NSVG__MMAP_MIN_SIZE (128*1024)
+static char* nsvg__mapFile(const char* filename, size_t* mapSize)
+{
+	struct stat st;
+	size_t size, len, page;
+	char* base;
+	char* data;
+	int fd;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return NULL;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < NSVG__MMAP_MIN_SIZE) {
+		close(fd);
+		return NULL;
+	}
+	size = (size_t)st.st_size;
+	page = (size_t)sysconf(_SC_PAGESIZE);
+	len = (size / page + 1) * page;
+
+	// Reserve room for the file and the terminator, then map the file over it.
+	base = (char*)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	data = (char*)mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		munmap(base, len);
+		return NULL;
+	}
+	madvise(data, size, MADV_SEQUENTIAL);
+#ifdef MADV_POPULATE_WRITE
+	// The parser writes to nearly every page, breaking copy on write one
+	// fault at a time. Doing it up front is much cheaper; on kernels
+	// without it (before 5.14) the pages are just faulted in lazily.
+	madvise(data, size, MADV_POPULATE_WRITE);
+#endif
+
+	*mapSize = len;
+	return data;
+}
+#endif
+
+static NSVGimage* nsvg__parseFromFile(const char* filename, const char* units, float dpi, const char* chars)
 {
 	FILE* fp = NULL;
 	size_t size;
 	char* data = NULL;
 	NSVGimage* image = NULL;
 
+#ifdef NSVG_HAVE_MMAP
+	data = nsvg__mapFile(filename, &size);
+	if (data != NULL) {
+		image = nsvg__parse(data, units, dpi, chars);
+		munmap(data, size);
+		return image;
+	}
+#endif
+
+	// Read small files and files that can't be mapped.
 	fp = fopen(filename, "rb");
 	if (!fp) goto error;
 	fseek(fp, 0, SEEK_END);
@@ -3032,7 +3955,7 @@ NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi)
 	if (fread(data, 1, size, fp) != size) goto error;
 	data[size] = '\0';	// Must be null terminated.
 	fclose(fp);
-	image = nsvgParse(data, units, dpi);
+	image = nsvg__parse(data, units, dpi, chars);
 	free(data);
 
 	return image;
@@ -3044,6 +3967,98 @@ error:
 	return NULL;
 }
 
+NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi)
+{
+	return nsvg__parseFromFile(filename, units, dpi, NULL);
+}
+
+NSVGimage* nsvgParseFontFromFile(const char* filename, const char* units, float dpi, const char* chars)
+{
+	return nsvg__parseFromFile(filename, units, dpi, chars);
+}
+
+#define NSVG__CHUNK_SIZE (64*1024)
+static NSVGimage* nsvg__parseChunked(const char* filename, const char* units, float dpi, const char* chars, size_t chunkSize)
+{
+	FILE* fp = NULL;
+	NSVGparser* p = NULL;
+	char* buf = NULL;
+	char* mark;
+	char* end;
+	size_t size, len = 0, scan = 0, n;
+	int inTag = 0;
+#ifdef POSIX_FADV_WILLNEED
+	off_t offset = 0;
+#endif
+
+	if (chunkSize == 0)
+		chunkSize = NSVG__CHUNK_SIZE;
+	size = chunkSize;
+
+	fp = fopen(filename, "rb");
+	if (!fp) goto error;
+	p = nsvg__startParse(dpi, chars);
+	if (p == NULL) goto error;
+	buf = (char*)malloc(size+1);
+	if (buf == NULL) goto error;
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	// buf holds the unfinished token from the last chunk, of which the
+	// first scan bytes have been looked at already, followed by a new chunk.
+	for (;;) {
+		if (len == size) {
+			// A single tag doesn't fit, make room for it.
+			char* grown = (char*)realloc(buf, size*2+1);
+			if (grown == NULL) goto error;
+			buf = grown;
+			size *= 2;
+		}
+		n = fread(buf + len, 1, size - len, fp);
+		if (n == 0) break;
+		len += n;
+		buf[len] = '\0';
+
+#ifdef POSIX_FADV_WILLNEED
+		// Have the kernel read the next chunk while this one is parsed.
+		offset += n;
+		posix_fadvise(fileno(fp), offset, chunkSize, POSIX_FADV_WILLNEED);
+#endif
+
+		mark = buf;
+		end = nsvg__scanXML(buf + scan, &mark, &inTag,
+							nsvg__startElement, nsvg__endElement, nsvg__content, p);
+		// Like the whole file parsers, stop at a stray zero byte.
+		if (end != buf + len) break;
+
+		len -= mark - buf;
+		scan = len;
+		memmove(buf, mark, len);
+	}
+	if (ferror(fp)) goto error;
+
+	free(buf);
+	fclose(fp);
+	return nsvg__endParse(p, units);
+
+error:
+	if (fp) fclose(fp);
+	free(buf);
+	if (p) nsvg__deleteParser(p);
+	return NULL;
+}
+
+NSVGimage* nsvgParseFromFileChunked(const char* filename, const char* units, float dpi, size_t chunkSize)
+{
+	return nsvg__parseChunked(filename, units, dpi, NULL, chunkSize);
+}
+
+NSVGimage* nsvgParseFontFromFileChunked(const char* filename, const char* units, float dpi, const char* chars, size_t chunkSize)
+{
+	return nsvg__parseChunked(filename, units, dpi, chars, chunkSize);
+}
+
 NSVGpath* nsvgDuplicatePath(NSVGpath* p)
 {
     NSVGpath* res = NULL;
@@ -3076,18 +4091,13 @@ error:
 
 void nsvgDelete(NSVGimage* image)
 {
-	NSVGshape *snext, *shape;
+	NSVGarenaBlock *block, *next;
 	if (image == NULL) return;
-	shape = image->shapes;
-	while (shape != NULL) {
-		snext = shape->next;
-		nsvg__deletePaths(shape->paths);
-		nsvg__deletePaint(&shape->fill);
-		nsvg__deletePaint(&shape->stroke);
-		free(shape);
-		shape = snext;
-	}
-	free(image);
+	// The image itself is in one of the blocks.
+	for (block = image->arena; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
 }
 
 #endif
@@ -65,12 +65,46 @@ void nsvgRasterize(NSVGrasterizer* r,
 // Deletes rasterizer context.
 void nsvgDeleteRasterizer(NSVGrasterizer*);
 
+enum NSVGrasterizerFlags {
+	// Rasterize the nonzero fills of all glyphs passed to nsvgRasterizeText()
+	// in one sweep, instead of one pass per glyph. Glyphs using the evenodd
+	// fill rule and strokes are still rasterized one at a time.
+	NSVG_RAST_TEXT_SINGLE_PASS = 1 << 0,
+	// Keep the coverage of every glyph drawn by nsvgRasterizeTextMask(),
+	// per scale and quarter pixel offset, and build later text from it.
+	// Glyph origins are snapped to the nearest quarter pixel.
+	NSVG_RAST_TEXT_GLYPH_CACHE = 1 << 1,
+	// Compute the exact area of each pixel covered by a fill, instead of
+	// sampling NSVG__SUBSAMPLES rows per pixel. Smoother antialiasing and
+	// fewer steps per row; coverage where evenodd fills or overlapping
+	// nonzero contours meet inside one pixel is approximate.
+	NSVG_RAST_ANALYTIC = 1 << 2,
+};
+
+// Sets NSVGrasterizerFlags, affects all following calls using r. Changing
+// NSVG_RAST_ANALYTIC drops all cached glyphs.
+void nsvgRasterizerSetFlags(NSVGrasterizer* r, int flags);
+
+// Drops all cached glyphs. The cache refers to the font's shapes, so this
+// has to be called before deleting a font the rasterizer has drawn text
+// with, unless the rasterizer is deleted first.
+void nsvgRasterizerClearGlyphCache(NSVGrasterizer* r);
 
+// Rasterizes text with an SVG font, in white, returns RGBA image
+// (non-premultiplied alpha). Lines are separated by '\n'.
 void nsvgRasterizeText(NSVGrasterizer* r,
 				   const NSVGimage* font, float tx, float ty, float scale,
 				   unsigned char* dst, int w, int h, int stride,
 				   const char* text);
 
+// Like nsvgRasterizeText(), but returns an 8-bit coverage mask, one byte
+// per pixel, which can be tinted with any colour when drawn.
+//   stride - number of bytes per scaleline in the destination buffer
+void nsvgRasterizeTextMask(NSVGrasterizer* r,
+				   const NSVGimage* font, float tx, float ty, float scale,
+				   unsigned char* dst, int w, int h, int stride,
+				   const char* text);
+
 
 #ifndef NANOSVGRAST_CPLUSPLUS
 #ifdef __cplusplus
@@ -84,11 +118,27 @@ void nsvgRasterizeText(NSVGrasterizer* r,
 
 #include <math.h>
 
+// Vector compositing needs GCC or Clang builtins, and pixels laid out the
+// way a little endian word holds them. AVX2 is picked at runtime.
+#if defined(__GNUC__) && defined(__SSE2__)
+#define NSVG__BLEND_SSE2 1
+#include <emmintrin.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define NSVG__BLEND_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__GNUC__) && defined(__ARM_NEON) && \
+	defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NSVG__BLEND_NEON 1
+#include <arm_neon.h>
+#endif
+
 #define NSVG__SUBSAMPLES	5
 #define NSVG__FIXSHIFT		10
 #define NSVG__FIX			(1 << NSVG__FIXSHIFT)
+#define NSVG__GLYPH_SUBPIXELS	4
+#define NSVG__GLYPH_BUCKETS	256
 #define NSVG__FIXMASK		(NSVG__FIX-1)
-#define NSVG__MEMPAGE_SIZE	1024
 
 typedef struct NSVGedge {
 	float x0,y0, x1,y1;
@@ -96,6 +146,11 @@ typedef struct NSVGedge {
 	struct NSVGedge* next;
 } NSVGedge;
 
+typedef struct NSVGedgeKey {
+	unsigned int key;
+	int index;
+} NSVGedgeKey;
+
 typedef struct NSVGpoint {
 	float x, y;
 	float dx, dy;
@@ -108,14 +163,24 @@ typedef struct NSVGactiveEdge {
 	int x,dx;
 	float ey;
 	int dir;
-	struct NSVGactiveEdge *next;
 } NSVGactiveEdge;
 
-typedef struct NSVGmemPage {
-	unsigned char mem[NSVG__MEMPAGE_SIZE];
-	int size;
-	struct NSVGmemPage* next;
-} NSVGmemPage;
+// An edge crossing the current row for the analytic engine, in pixels
+typedef struct NSVGcoverEdge {
+	float x0, y0, y1;
+	float dxdy;
+	float dir;
+} NSVGcoverEdge;
+
+typedef struct NSVGcachedGlyph {
+	const NSVGshape* shape;
+	float scale;
+	int fx, fy;		// Subpixel offset of the origin, in 1/NSVG__GLYPH_SUBPIXELS
+	int x0, y0;		// Position of the mask relative to the origin
+	int w, h;
+	unsigned char* mask;
+	struct NSVGcachedGlyph* next;
+} NSVGcachedGlyph;
 
 typedef struct NSVGcachedPaint {
 	char type;
@@ -124,6 +189,11 @@ typedef struct NSVGcachedPaint {
 	unsigned int colors[256];
 } NSVGcachedPaint;
 
+// Blends count pixels of colors, or of colors[0] for all if solid, over dst
+// with the coverage in cover
+typedef void (*NSVGblendSpanFunc)(unsigned char* dst, int count, const unsigned char* cover,
+								  const unsigned int* colors, int solid);
+
 struct NSVGrasterizer
 {
 	float px, py;
@@ -135,6 +205,12 @@ struct NSVGrasterizer
 	int nedges;
 	int cedges;
 
+	// Scratch space for sorting edges
+	NSVGedge* sortedEdges;
+	int csortedEdges;
+	NSVGedgeKey* edgeKeys;
+	int cedgeKeys;
+
 	NSVGpoint* points;
 	int npoints;
 	int cpoints;
@@ -143,17 +219,37 @@ struct NSVGrasterizer
 	int npoints2;
 	int cpoints2;
 
-	NSVGactiveEdge* freelist;
-	NSVGmemPage* pages;
-	NSVGmemPage* curpage;
+	// Edges crossing the current scanline sorted by x, and those joining
+	// them on it, both with room for all nedges.
+	NSVGactiveEdge* active;
+	NSVGactiveEdge* added;
+	int cactive;
+
+	// The same for the analytic engine, and the coverage it accumulates
+	// for a row, with room for two more pixels than the bitmap is wide.
+	NSVGcoverEdge* coverEdges;
+	int ccoverEdges;
+	float* cover;
+	int ccover;
 
 	unsigned char* scanline;
 	int cscanline;
 
 	unsigned char* bitmap;
 	int width, height, stride;
+	// Bytes per pixel of bitmap, 1 for coverage masks
+	int bpp;
+
+	int flags;
+
+	// Compositing kernel for the CPU, picked on creation
+	NSVGblendSpanFunc blendSpan;
+
+	NSVGcachedGlyph* glyphs[NSVG__GLYPH_BUCKETS];
 };
 
+static NSVGblendSpanFunc nsvg__pickBlendSpan(void);
+
 NSVGrasterizer* nsvgCreateRasterizer()
 {
 	NSVGrasterizer* r = (NSVGrasterizer*)malloc(sizeof(NSVGrasterizer));
@@ -162,6 +258,7 @@ NSVGrasterizer* nsvgCreateRasterizer()
 
 	r->tessTol = 0.25f;
 	r->distTol = 0.01f;
+	r->blendSpan = nsvg__pickBlendSpan();
 
 	return r;
 
@@ -172,68 +269,44 @@ error:
 
 void nsvgDeleteRasterizer(NSVGrasterizer* r)
 {
-	NSVGmemPage* p;
-
 	if (r == NULL) return;
 
-	p = r->pages;
-	while (p != NULL) {
-		NSVGmemPage* next = p->next;
-		free(p);
-		p = next;
-	}
-
 	if (r->edges) free(r->edges);
+	if (r->sortedEdges) free(r->sortedEdges);
+	if (r->edgeKeys) free(r->edgeKeys);
+	if (r->active) free(r->active);
+	if (r->added) free(r->added);
+	if (r->coverEdges) free(r->coverEdges);
+	if (r->cover) free(r->cover);
 	if (r->points) free(r->points);
 	if (r->points2) free(r->points2);
 	if (r->scanline) free(r->scanline);
 
+	nsvgRasterizerClearGlyphCache(r);
 	free(r);
 }
 
-static NSVGmemPage* nsvg__nextPage(NSVGrasterizer* r, NSVGmemPage* cur)
+void nsvgRasterizerSetFlags(NSVGrasterizer* r, int flags)
 {
-	NSVGmemPage *newp;
-
-	// If using existing chain, return the next page in chain
-	if (cur != NULL && cur->next != NULL) {
-		return cur->next;
-	}
-
-	// Alloc new page
-	newp = (NSVGmemPage*)malloc(sizeof(NSVGmemPage));
-	if (newp == NULL) return NULL;
-	memset(newp, 0, sizeof(NSVGmemPage));
-
-	// Add to linked list
-	if (cur != NULL)
-		cur->next = newp;
-	else
-		r->pages = newp;
-
-	return newp;
+	// Cached masks were drawn by the fill engine in use at the time
+	if ((r->flags ^ flags) & NSVG_RAST_ANALYTIC)
+		nsvgRasterizerClearGlyphCache(r);
+	r->flags = flags;
 }
 
-static void nsvg__resetPool(NSVGrasterizer* r)
+void nsvgRasterizerClearGlyphCache(NSVGrasterizer* r)
 {
-	NSVGmemPage* p = r->pages;
-	while (p != NULL) {
-		p->size = 0;
-		p = p->next;
-	}
-	r->curpage = r->pages;
-}
+	NSVGcachedGlyph* g;
+	int i;
 
-static unsigned char* nsvg__alloc(NSVGrasterizer* r, int size)
-{
-	unsigned char* buf;
-	if (size > NSVG__MEMPAGE_SIZE) return NULL;
-	if (r->curpage == NULL || r->curpage->size+size > NSVG__MEMPAGE_SIZE) {
-		r->curpage = nsvg__nextPage(r, r->curpage);
+	for (i = 0; i < NSVG__GLYPH_BUCKETS; i++) {
+		while (r->glyphs[i] != NULL) {
+			g = r->glyphs[i];
+			r->glyphs[i] = g->next;
+			free(g->mask);
+			free(g);
+		}
 	}
-	buf = &r->curpage->mem[r->curpage->size];
-	r->curpage->size += size;
-	return buf;
 }
 
 static int nsvg__ptEquals(float x1, float y1, float x2, float y2, float tol)
@@ -847,31 +920,108 @@ static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float
 	}
 }
 
-static int nsvg__cmpEdge(const void *p, const void *q)
-{
-	const NSVGedge* a = (const NSVGedge*)p;
-	const NSVGedge* b = (const NSVGedge*)q;
+// Below this many edges insertion sort beats setting up a radix sort
+#define NSVG__RADIX_SORT_MIN 64
 
-	if (a->y0 < b->y0) return -1;
-	if (a->y0 > b->y0) return  1;
-	return 0;
+// Maps y to an integer that sorts the same: flipping the sign bit of
+// positive floats and all bits of negative ones orders them as unsigned.
+static unsigned int nsvg__edgeKey(float y)
+{
+	union { float f; unsigned int u; } v;
+	v.f = y;
+	if (v.u == 0x80000000u) v.u = 0;	// -0 and 0 are equal
+	return (v.u & 0x80000000u) ? ~v.u : v.u | 0x80000000u;
 }
 
+static void nsvg__insertionSortEdges(NSVGedge* edges, int n)
+{
+	NSVGedge e;
+	int i, j;
+
+	for (i = 1; i < n; i++) {
+		e = edges[i];
+		for (j = i; j > 0 && edges[j-1].y0 > e.y0; j--)
+			edges[j] = edges[j-1];
+		edges[j] = e;
+	}
+}
 
-static NSVGactiveEdge* nsvg__addActive(NSVGrasterizer* r, NSVGedge* e, float startPoint)
+// Sorts the edges by y0, keeping edges with equal y0 in the order they
+// were added. Longer lists are radix sorted a byte at a time on the key
+// of y0, then moved into place at once.
+static void nsvg__sortEdges(NSVGrasterizer* r)
 {
-	NSVGactiveEdge* z;
+	unsigned int counts[4][256];
+	NSVGedgeKey *keys, *tmp, *swap;
+	NSVGedge* sorted;
+	int n = r->nedges;
+	int i, pass, sum, c;
+
+	if (n < NSVG__RADIX_SORT_MIN) {
+		nsvg__insertionSortEdges(r->edges, n);
+		return;
+	}
 
-	if (r->freelist != NULL) {
-		// Restore from freelist.
-		z = r->freelist;
-		r->freelist = z->next;
-	} else {
-		// Alloc new edge.
-		z = (NSVGactiveEdge*)nsvg__alloc(r, sizeof(NSVGactiveEdge));
-		if (z == NULL) return NULL;
+	if (n > r->csortedEdges) {
+		free(r->sortedEdges);
+		r->csortedEdges = r->cedges;
+		r->sortedEdges = (NSVGedge*)malloc(sizeof(NSVGedge) * r->csortedEdges);
+		if (r->sortedEdges == NULL) r->csortedEdges = 0;
+	}
+	if (n*2 > r->cedgeKeys) {
+		free(r->edgeKeys);
+		r->cedgeKeys = r->cedges*2;
+		r->edgeKeys = (NSVGedgeKey*)malloc(sizeof(NSVGedgeKey) * r->cedgeKeys);
+		if (r->edgeKeys == NULL) r->cedgeKeys = 0;
+	}
+	if (r->sortedEdges == NULL || r->edgeKeys == NULL) {
+		nsvg__insertionSortEdges(r->edges, n);
+		return;
+	}
+	keys = r->edgeKeys;
+	tmp = r->edgeKeys + n;
+
+	// Count the digits of all four passes in one go
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < n; i++) {
+		unsigned int key = nsvg__edgeKey(r->edges[i].y0);
+		keys[i].key = key;
+		keys[i].index = i;
+		counts[0][key & 0xff]++;
+		counts[1][(key >> 8) & 0xff]++;
+		counts[2][(key >> 16) & 0xff]++;
+		counts[3][key >> 24]++;
+	}
+
+	for (pass = 0; pass < 4; pass++) {
+		int shift = pass * 8;
+		unsigned int* count = counts[pass];
+		// Nothing moves if every key has the same digit, as the top ones often do
+		if (count[(keys[0].key >> shift) & 0xff] == (unsigned int)n)
+			continue;
+		for (i = 0, sum = 0; i < 256; i++) {
+			c = (int)count[i];
+			count[i] = (unsigned int)sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++)
+			tmp[count[(keys[i].key >> shift) & 0xff]++] = keys[i];
+		swap = keys; keys = tmp; tmp = swap;
 	}
 
+	sorted = r->sortedEdges;
+	for (i = 0; i < n; i++)
+		sorted[i] = r->edges[keys[i].index];
+	r->sortedEdges = r->edges;
+	r->edges = sorted;
+	c = r->csortedEdges;
+	r->csortedEdges = r->cedges;
+	r->cedges = c;
+}
+
+
+static void nsvg__initActive(NSVGactiveEdge* z, NSVGedge* e, float startPoint)
+{
 	float dxdy = (e->x1 - e->x0) / (e->y1 - e->y0);
 //	STBTT_assert(e->y0 <= start_point);
 	// round dx down to avoid going too far
@@ -882,16 +1032,7 @@ static NSVGactiveEdge* nsvg__addActive(NSVGrasterizer* r, NSVGedge* e, float sta
 	z->x = (int)floorf(NSVG__FIX * (e->x0 + dxdy * (startPoint - e->y0)));
 //	z->x -= off_x * FIX;
 	z->ey = e->y1;
-	z->next = 0;
 	z->dir = e->dir;
-
-	return z;
-}
-
-static void nsvg__freeActive(NSVGrasterizer* r, NSVGactiveEdge* z)
-{
-	z->next = r->freelist;
-	r->freelist = z;
 }
 
 static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1, int maxWeight, int* xmin, int* xmax)
@@ -924,14 +1065,15 @@ static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1,
 // note: this routine clips fills that extend off the edges... ideally this
 // wouldn't happen, but it could happen if the truetype glyph bounding boxes
 // are wrong, or if the user supplies a too-small bitmap
-static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEdge* e, int maxWeight, int* xmin, int* xmax, char fillRule)
+static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEdge* e, int nactive, int maxWeight, int* xmin, int* xmax, char fillRule)
 {
 	// non-zero winding fill
 	int x0 = 0, w = 0;
+	NSVGactiveEdge* end = e + nactive;
 
 	if (fillRule == NSVG_FILLRULE_NONZERO) {
 		// Non-zero
-		while (e != NULL) {
+		for (; e < end; e++) {
 			if (w == 0) {
 				// if we're currently at zero, we need to record the edge start point
 				x0 = e->x; w += e->dir;
@@ -941,11 +1083,10 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
 				if (w == 0)
 					nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
 			}
-			e = e->next;
 		}
 	} else if (fillRule == NSVG_FILLRULE_EVENODD) {
 		// Even-odd
-		while (e != NULL) {
+		for (; e < end; e++) {
 			if (w == 0) {
 				// if we're currently at zero, we need to record the edge start point
 				x0 = e->x; w = 1;
@@ -953,7 +1094,6 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
 				int x1 = e->x; w = 0;
 				nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
 			}
-			e = e->next;
 		}
 	}
 }
@@ -990,217 +1130,750 @@ static inline int nsvg__div255(int x)
     return ((x+1) * 257) >> 16;
 }
 
-static void nsvg__scanlineSolid(unsigned char* dst, int count, unsigned char* cover, int x, int y,
-								float tx, float ty, float scale, NSVGcachedPaint* cache)
+static void nsvg__blendSpan(unsigned char* dst, int count, const unsigned char* cover,
+							const unsigned int* colors, int solid)
 {
+	int i;
 
-	if (cache->type == NSVG_PAINT_COLOR) {
-		int i, cr, cg, cb, ca;
-		cr = cache->colors[0] & 0xff;
-		cg = (cache->colors[0] >> 8) & 0xff;
-		cb = (cache->colors[0] >> 16) & 0xff;
-		ca = (cache->colors[0] >> 24) & 0xff;
-
-		for (i = 0; i < count; i++) {
-			int r,g,b;
-			int a = nsvg__div255((int)cover[0] * ca);
-			int ia = 255 - a;
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
+	for (i = 0; i < count; i++) {
+		unsigned int c = colors[solid ? 0 : i];
+		int r,g,b,a,ia;
+		// Blending in nothing leaves dst as it is
+		if (cover[i] == 0)
+			continue;
+		a = nsvg__div255((int)cover[i] * (int)((c >> 24) & 0xff));
+		ia = 255 - a;
+
+		// Premultiply
+		r = nsvg__div255((int)(c & 0xff) * a);
+		g = nsvg__div255((int)((c >> 8) & 0xff) * a);
+		b = nsvg__div255((int)((c >> 16) & 0xff) * a);
+
+		// Blend over
+		r += nsvg__div255(ia * (int)dst[i*4+0]);
+		g += nsvg__div255(ia * (int)dst[i*4+1]);
+		b += nsvg__div255(ia * (int)dst[i*4+2]);
+		a += nsvg__div255(ia * (int)dst[i*4+3]);
+
+		dst[i*4+0] = (unsigned char)r;
+		dst[i*4+1] = (unsigned char)g;
+		dst[i*4+2] = (unsigned char)b;
+		dst[i*4+3] = (unsigned char)a;
+	}
+}
+
+// The vector kernels below do the same sums in 16 bit lanes, giving the
+// same bytes. nsvg__div255(x) is (x+1)*257 >> 16, and its result never
+// takes a channel past 255. Groups of pixels with no coverage are skipped,
+// and opaque colours at full coverage are stored as they are, which is
+// what blending gives for them too.
+#ifdef NSVG__BLEND_SSE2
+
+static inline __m128i nsvg__div255SSE2(__m128i x)
+{
+	return _mm_mulhi_epu16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_set1_epi16(257));
+}
+
+// Blends two pixels, as 16 bit channels. cv holds their coverage in all
+// four lanes of each.
+static inline __m128i nsvg__blendPairSSE2(__m128i c, __m128i d, __m128i cv)
+{
+	// Alpha of the colour in all lanes, and 255 in its place for premultiplying
+	__m128i ca = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xff), 0xff);
+	__m128i a = nsvg__div255SSE2(_mm_mullo_epi16(cv, ca));
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	c = _mm_or_si128(c, _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+	return _mm_add_epi16(nsvg__div255SSE2(_mm_mullo_epi16(c, a)),
+						 nsvg__div255SSE2(_mm_mullo_epi16(d, ia)));
+}
+
+static void nsvg__blendSpanSSE2(unsigned char* dst, int count, const unsigned char* cover,
+								const unsigned int* colors, int solid)
+{
+	// Only solid colours are used before loading per pixel ones
+	unsigned int c0 = solid ? colors[0] : 0;
+	__m128i zero = _mm_setzero_si128();
+	__m128i c = _mm_set1_epi32((int)c0);
+	int opaque = solid && (c0 >> 24) == 255;
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		unsigned int cv;
+		__m128i d, cv16;
+		memcpy(&cv, &cover[i], 4);
+		if (cv == 0)
+			continue;
+		if (cv == 0xffffffffu && opaque) {
+			_mm_storeu_si128((__m128i*)&dst[i*4], c);
+			continue;
 		}
-	} else if (cache->type == NSVG_PAINT_LINEAR_GRADIENT) {
-		// TODO: spread modes.
-		// TODO: plenty of opportunities to optimize.
-		float fx, fy, dx, gy;
-		float* t = cache->xform;
-		int i, cr, cg, cb, ca;
-		unsigned int c;
+		if (!solid)
+			c = _mm_loadu_si128((const __m128i*)&colors[i]);
+		d = _mm_loadu_si128((const __m128i*)&dst[i*4]);
+		// Coverage of each pixel in its four lanes
+		cv16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)cv), zero);
+		cv16 = _mm_unpacklo_epi16(cv16, cv16);
+		d = _mm_packus_epi16(
+			nsvg__blendPairSSE2(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero),
+								_mm_unpacklo_epi32(cv16, cv16)),
+			nsvg__blendPairSSE2(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero),
+								_mm_unpackhi_epi32(cv16, cv16)));
+		_mm_storeu_si128((__m128i*)&dst[i*4], d);
+	}
+	nsvg__blendSpan(&dst[i*4], count - i, &cover[i], solid ? colors : &colors[i], solid);
+}
 
-		fx = ((float)x - tx) / scale;
-		fy = ((float)y - ty) / scale;
-		dx = 1.0f / scale;
+#endif
 
-		for (i = 0; i < count; i++) {
-			int r,g,b,a,ia;
-			gy = fx*t[1] + fy*t[3] + t[5];
-			c = cache->colors[(int)nsvg__clampf(gy*255.0f, 0, 255.0f)];
-			cr = (c) & 0xff;
-			cg = (c >> 8) & 0xff;
-			cb = (c >> 16) & 0xff;
-			ca = (c >> 24) & 0xff;
-
-			a = nsvg__div255((int)cover[0] * ca);
-			ia = 255 - a;
-
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-			fx += dx;
+#ifdef NSVG__BLEND_AVX2
+
+// The same as the SSE2 kernel, eight pixels at a time. Unpacking works
+// within each 128 bit half, so the pairs are pixels 0,1,4,5 and 2,3,6,7,
+// and packing puts them back in order.
+__attribute__((target("avx2")))
+static inline __m256i nsvg__div255AVX2(__m256i x)
+{
+	return _mm256_mulhi_epu16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_set1_epi16(257));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i nsvg__blendPairAVX2(__m256i c, __m256i d, __m256i cv)
+{
+	__m256i ca = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c, 0xff), 0xff);
+	__m256i a = nsvg__div255AVX2(_mm256_mullo_epi16(cv, ca));
+	__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+	c = _mm256_or_si256(c, _mm256_set1_epi64x(255LL << 48));
+	return _mm256_add_epi16(nsvg__div255AVX2(_mm256_mullo_epi16(c, a)),
+							nsvg__div255AVX2(_mm256_mullo_epi16(d, ia)));
+}
+
+__attribute__((target("avx2")))
+static void nsvg__blendSpanAVX2(unsigned char* dst, int count, const unsigned char* cover,
+								const unsigned int* colors, int solid)
+{
+	unsigned int c0 = solid ? colors[0] : 0;
+	__m256i zero = _mm256_setzero_si256();
+	__m256i c = _mm256_set1_epi32((int)c0);
+	int opaque = solid && (c0 >> 24) == 255;
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		unsigned long long cv;
+		__m256i d, cv16;
+		memcpy(&cv, &cover[i], 8);
+		if (cv == 0)
+			continue;
+		if (cv == 0xffffffffffffffffull && opaque) {
+			_mm256_storeu_si256((__m256i*)&dst[i*4], c);
+			continue;
+		}
+		if (!solid)
+			c = _mm256_loadu_si256((const __m256i*)&colors[i]);
+		d = _mm256_loadu_si256((const __m256i*)&dst[i*4]);
+		// Coverage of pixels 0-3 and 4-7 in each 32 bit lane of the halves,
+		// then in both of its 16 bit lanes
+		cv16 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&cover[i]));
+		cv16 = _mm256_or_si256(cv16, _mm256_slli_epi32(cv16, 16));
+		d = _mm256_packus_epi16(
+			nsvg__blendPairAVX2(_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(d, zero),
+								_mm256_unpacklo_epi32(cv16, cv16)),
+			nsvg__blendPairAVX2(_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(d, zero),
+								_mm256_unpackhi_epi32(cv16, cv16)));
+		_mm256_storeu_si256((__m256i*)&dst[i*4], d);
+	}
+	// GCC doesn't clear the upper halves for functions only targeted at
+	// AVX2, and SSE code after them would pay for it
+	_mm256_zeroupper();
+	nsvg__blendSpanSSE2(&dst[i*4], count - i, &cover[i], solid ? colors : &colors[i], solid);
+}
+
+#endif
+
+#ifdef NSVG__BLEND_NEON
+
+// (x+1)*257 >> 16 narrowed to bytes, as ((x+1) + ((x+1) >> 8)) >> 8, which
+// is the same and stays within 16 bits
+static inline uint8x8_t nsvg__div255NEON(uint16x8_t x)
+{
+	x = vaddq_u16(x, vdupq_n_u16(1));
+	return vshrn_n_u16(vsraq_n_u16(x, x, 8), 8);
+}
+
+// Eight pixels at a time, with the channels loaded into separate vectors
+static void nsvg__blendSpanNEON(unsigned char* dst, int count, const unsigned char* cover,
+								const unsigned int* colors, int solid)
+{
+	unsigned int c0 = solid ? colors[0] : 0;
+	uint8x8x4_t c, d;
+	int opaque = solid && (c0 >> 24) == 255;
+	int i;
+
+	c.val[0] = vdup_n_u8(c0 & 0xff);
+	c.val[1] = vdup_n_u8((c0 >> 8) & 0xff);
+	c.val[2] = vdup_n_u8((c0 >> 16) & 0xff);
+	c.val[3] = vdup_n_u8(c0 >> 24);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		unsigned long long cv;
+		uint8x8_t a, ia;
+		memcpy(&cv, &cover[i], 8);
+		if (cv == 0)
+			continue;
+		if (cv == 0xffffffffffffffffull && opaque) {
+			vst4_u8(&dst[i*4], c);
+			continue;
 		}
-	} else if (cache->type == NSVG_PAINT_RADIAL_GRADIENT) {
-		// TODO: spread modes.
-		// TODO: plenty of opportunities to optimize.
+		if (!solid)
+			c = vld4_u8((const uint8_t*)&colors[i]);
+		d = vld4_u8(&dst[i*4]);
+		a = nsvg__div255NEON(vmull_u8(vld1_u8(&cover[i]), c.val[3]));
+		ia = vmvn_u8(a);
+		d.val[0] = vadd_u8(nsvg__div255NEON(vmull_u8(c.val[0], a)),
+						   nsvg__div255NEON(vmull_u8(d.val[0], ia)));
+		d.val[1] = vadd_u8(nsvg__div255NEON(vmull_u8(c.val[1], a)),
+						   nsvg__div255NEON(vmull_u8(d.val[1], ia)));
+		d.val[2] = vadd_u8(nsvg__div255NEON(vmull_u8(c.val[2], a)),
+						   nsvg__div255NEON(vmull_u8(d.val[2], ia)));
+		d.val[3] = vadd_u8(a, nsvg__div255NEON(vmull_u8(d.val[3], ia)));
+		vst4_u8(&dst[i*4], d);
+	}
+	nsvg__blendSpan(&dst[i*4], count - i, &cover[i], solid ? colors : &colors[i], solid);
+}
+
+#endif
+
+static NSVGblendSpanFunc nsvg__pickBlendSpan(void)
+{
+#if defined(NSVG__BLEND_AVX2)
+	if (__builtin_cpu_supports("avx2"))
+		return nsvg__blendSpanAVX2;
+#endif
+#if defined(NSVG__BLEND_SSE2)
+	return nsvg__blendSpanSSE2;
+#elif defined(NSVG__BLEND_NEON)
+	return nsvg__blendSpanNEON;
+#else
+	return nsvg__blendSpan;
+#endif
+}
+
+// Gradient colours are looked up this many pixels at a time, then blended
+#define NSVG__BLEND_CHUNK	64
+
+// Index into the cached gradient colours for offset t, which is spread
+// past [0,1] by padding, repeating or reflecting the gradient
+static inline int nsvg__gradientIndex(float t, int spread)
+{
+	if (spread == NSVG_SPREAD_REPEAT) {
+		t -= floorf(t);
+	} else if (spread == NSVG_SPREAD_REFLECT) {
+		t -= 2.0f * floorf(t * 0.5f);
+		if (t > 1.0f) t = 2.0f - t;
+	}
+	return (int)nsvg__clampf(t * 255.0f, 0, 255.0f);
+}
+
+// sqrtf(x) to within 0.2%, well under a colour step of a gradient, from the
+// usual estimate of 1/sqrt(x) and one Newton step. Stepping can take x a
+// little below zero, that gives zero.
+static inline float nsvg__sqrtApprox(float x)
+{
+	union { float f; unsigned int i; } u;
+	float y;
+
+	x = x < 1e-20f ? 1e-20f : x;
+	u.f = x;
+	u.i = 0x5f3759df - (u.i >> 1);
+	y = u.f;
+	y = y * (1.5f - 0.5f * x * y * y);
+	return x * y;
+}
+
+#if defined(NSVG__BLEND_SSE2)
+
+static inline __m128 nsvg__floorSSE2(__m128 x)
+{
+	__m128 f = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	return _mm_sub_ps(f, _mm_and_ps(_mm_cmpgt_ps(f, x), _mm_set1_ps(1.0f)));
+}
+
+#elif defined(NSVG__BLEND_NEON)
+
+static inline float32x4_t nsvg__floorNEON(float32x4_t x)
+{
+	float32x4_t f = vcvtq_f32_s32(vcvtq_s32_f32(x));
+	uint32x4_t one = vreinterpretq_u32_f32(vdupq_n_f32(1.0f));
+	return vsubq_f32(f, vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(f, x), one)));
+}
+
+#endif
+
+#if defined(NSVG__BLEND_SSE2) || defined(NSVG__BLEND_NEON)
+
+// Looks up the colours of four indices, or as many as there are pixels left
+static inline void nsvg__lookupColors(unsigned int* colors, int n, NSVGcachedPaint* cache, const int* idx)
+{
+	int k;
+
+	if (n >= 4) {
+		colors[0] = cache->colors[idx[0]];
+		colors[1] = cache->colors[idx[1]];
+		colors[2] = cache->colors[idx[2]];
+		colors[3] = cache->colors[idx[3]];
+		return;
+	}
+	for (k = 0; k < n; k++)
+		colors[k] = cache->colors[idx[k]];
+}
+
+#endif
+
+// Looks up the colours of n pixels of a gradient. Along a row the offset of
+// a linear gradient steps by the same amount each pixel, and the squared
+// offset of a radial one is a quadratic, so both are stepped from q by d,
+// which itself steps by dd. Vector lanes step four pixels apart, by the
+// differences four pixels apart.
+static void nsvg__gradientColors(unsigned int* colors, int n, NSVGcachedPaint* cache,
+								 float q, float d, float dd, int radial)
+{
+	int spread = cache->spread;
+	int i;
+#if defined(NSVG__BLEND_SSE2) || defined(NSVG__BLEND_NEON)
+	float start[8];
+	int idx[4], k;
+
+	for (k = 0; k < 8; k++) {
+		start[k] = q;
+		q += d;
+		d += dd;
+	}
+#endif
+
+#if defined(NSVG__BLEND_SSE2)
+	{
+		__m128 vq = _mm_loadu_ps(start);
+		__m128 vd = _mm_sub_ps(_mm_loadu_ps(start + 4), vq);
+		__m128 vdd = _mm_set1_ps(16.0f * dd);
+
+		for (i = 0; i < n; i += 4) {
+			__m128 t = vq;
+			if (radial) {
+				__m128 x = _mm_max_ps(t, _mm_set1_ps(1e-20f));
+				t = _mm_mul_ps(x, _mm_rsqrt_ps(x));
+			}
+			if (spread == NSVG_SPREAD_REPEAT) {
+				t = _mm_sub_ps(t, nsvg__floorSSE2(t));
+			} else if (spread == NSVG_SPREAD_REFLECT) {
+				__m128 two = _mm_set1_ps(2.0f);
+				t = _mm_sub_ps(t, _mm_mul_ps(two, nsvg__floorSSE2(_mm_mul_ps(t, _mm_set1_ps(0.5f)))));
+				t = _mm_min_ps(t, _mm_sub_ps(two, t));
+			}
+			// Past either end, and NaN, become the end colours
+			t = _mm_max_ps(_mm_mul_ps(t, _mm_set1_ps(255.0f)), _mm_setzero_ps());
+			t = _mm_min_ps(t, _mm_set1_ps(255.0f));
+			_mm_storeu_si128((__m128i*)idx, _mm_cvttps_epi32(t));
+			nsvg__lookupColors(&colors[i], n - i, cache, idx);
+			vq = _mm_add_ps(vq, vd);
+			vd = _mm_add_ps(vd, vdd);
+		}
+	}
+#elif defined(NSVG__BLEND_NEON)
+	{
+		float32x4_t vq = vld1q_f32(start);
+		float32x4_t vd = vsubq_f32(vld1q_f32(start + 4), vq);
+		float32x4_t vdd = vdupq_n_f32(16.0f * dd);
+
+		for (i = 0; i < n; i += 4) {
+			float32x4_t t = vq;
+			if (radial) {
+				float32x4_t x = vmaxq_f32(t, vdupq_n_f32(1e-20f));
+				float32x4_t e = vrsqrteq_f32(x);
+				e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+				t = vmulq_f32(x, e);
+			}
+			if (spread == NSVG_SPREAD_REPEAT) {
+				t = vsubq_f32(t, nsvg__floorNEON(t));
+			} else if (spread == NSVG_SPREAD_REFLECT) {
+				float32x4_t two = vdupq_n_f32(2.0f);
+				t = vsubq_f32(t, vmulq_f32(two, nsvg__floorNEON(vmulq_f32(t, vdupq_n_f32(0.5f)))));
+				t = vminq_f32(t, vsubq_f32(two, t));
+			}
+			// Past either end become the end colours, and NaN converts to 0
+			t = vmaxq_f32(vmulq_f32(t, vdupq_n_f32(255.0f)), vdupq_n_f32(0.0f));
+			t = vminq_f32(t, vdupq_n_f32(255.0f));
+			vst1q_s32(idx, vcvtq_s32_f32(t));
+			nsvg__lookupColors(&colors[i], n - i, cache, idx);
+			vq = vaddq_f32(vq, vd);
+			vd = vaddq_f32(vd, vdd);
+		}
+	}
+#else
+	for (i = 0; i < n; i++) {
+		float t = radial ? nsvg__sqrtApprox(q) : q;
+		colors[i] = cache->colors[nsvg__gradientIndex(t, spread)];
+		q += d;
+		d += dd;
+	}
+#endif
+}
+
+static void nsvg__scanlineSolid(NSVGrasterizer* r, unsigned char* dst, int count, unsigned char* cover,
+								int x, int y, float tx, float ty, float scale, NSVGcachedPaint* cache)
+{
+	if (cache->type == NSVG_PAINT_COLOR) {
+		r->blendSpan(dst, count, cover, cache->colors, 1);
+	} else if (cache->type == NSVG_PAINT_LINEAR_GRADIENT ||
+			   cache->type == NSVG_PAINT_RADIAL_GRADIENT) {
 		// TODO: focus (fx,fy)
-		float fx, fy, dx, gx, gy, gd;
+		// The gradient is only transformed at the start of each chunk, which
+		// keeps stepping from drifting over long rows
+		unsigned int colors[NSVG__BLEND_CHUNK];
+		int radial = cache->type == NSVG_PAINT_RADIAL_GRADIENT;
+		float fx, fy, gx, gy, dgx, dgy;
 		float* t = cache->xform;
-		int i, cr, cg, cb, ca;
-		unsigned int c;
+		int n;
 
-		fx = ((float)x - tx) / scale;
 		fy = ((float)y - ty) / scale;
-		dx = 1.0f / scale;
+		dgx = t[0] / scale;
+		dgy = t[1] / scale;
 
-		for (i = 0; i < count; i++) {
-			int r,g,b,a,ia;
+		for (; count > 0; count -= n, x += n) {
+			n = count < NSVG__BLEND_CHUNK ? count : NSVG__BLEND_CHUNK;
+			fx = ((float)x - tx) / scale;
 			gx = fx*t[0] + fy*t[2] + t[4];
 			gy = fx*t[1] + fy*t[3] + t[5];
-			gd = sqrtf(gx*gx + gy*gy);
-			c = cache->colors[(int)nsvg__clampf(gd*255.0f, 0, 255.0f)];
-			cr = (c) & 0xff;
-			cg = (c >> 8) & 0xff;
-			cb = (c >> 16) & 0xff;
-			ca = (c >> 24) & 0xff;
-
-			a = nsvg__div255((int)cover[0] * ca);
-			ia = 255 - a;
-
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-			fx += dx;
+			if (radial)
+				nsvg__gradientColors(colors, n, cache, gx*gx + gy*gy,
+									 2.0f * (gx*dgx + gy*dgy) + dgx*dgx + dgy*dgy,
+									 2.0f * (dgx*dgx + dgy*dgy), 1);
+			else
+				nsvg__gradientColors(colors, n, cache, gy, dgy, 0.0f, 0);
+			r->blendSpan(dst, n, cover, colors, 0);
+			dst += n*4;
+			cover += n;
+		}
+	}
+}
+
+// Accumulates coverage into a mask, only the paint's alpha is used
+static void nsvg__scanlineMask(unsigned char* dst, int count, unsigned char* cover, NSVGcachedPaint* cache)
+{
+	int i, a, ca = (cache->colors[0] >> 24) & 0xff;
+
+	for (i = 0; i < count; i++) {
+		if (cover[i] == 0)
+			continue;
+		a = nsvg__div255((int)cover[i] * ca);
+		dst[i] = (unsigned char)(a + nsvg__div255((255 - a) * (int)dst[i]));
+	}
+}
+
+// Adds the coverage of a line crossing a row between x0 and x1, which are
+// within [0, width], to cover. d is the height of the line in the row times
+// its direction. Summing cover from the left gives, for each pixel, d times
+// how much of it lies right of the line, the usual signed area method.
+static void nsvg__accumulateLine(float* cover, float x0, float x1, float d)
+{
+	float s, f0, f1, a0, a1, a2, am;
+	int i, i0, i1;
+
+	if (x0 > x1) {
+		s = x0; x0 = x1; x1 = s;
+	}
+	i0 = (int)x0;
+	i1 = (int)ceilf(x1);
+
+	if (i1 <= i0 + 1) {
+		// Within one pixel, its part right of the line's middle is covered
+		float xm = 0.5f * (x0 + x1) - i0;
+		cover[i0] += d - d * xm;
+		cover[i0+1] += d * xm;
+		return;
+	}
+
+	// The line covers a triangle of its first and last pixels, and each
+	// pixel in between 1/(x1-x0) more than the one before.
+	s = 1.0f / (x1 - x0);
+	f0 = x0 - i0;
+	a0 = 0.5f * s * (1.0f - f0) * (1.0f - f0);
+	f1 = x1 - i1 + 1.0f;
+	am = 0.5f * s * f1 * f1;
+	cover[i0] += d * a0;
+	if (i1 == i0 + 2) {
+		cover[i0+1] += d * (1.0f - a0 - am);
+	} else {
+		a1 = s * (1.5f - f0);
+		cover[i0+1] += d * (a1 - a0);
+		for (i = i0 + 2; i < i1 - 1; i++)
+			cover[i] += d * s;
+		a2 = a1 + (i1 - i0 - 3) * s;
+		cover[i1-1] += d * (1.0f - a2 - am);
+	}
+	cover[i1] += d * am;
+}
+
+// Like nsvg__accumulateLine(), for any x0 and x1. Parts of the line left of
+// the bitmap cover everything to their right, so they move to its left edge;
+// parts right of it cover nothing visible.
+static void nsvg__accumulateClipped(float* cover, int width, float x0, float x1, float d)
+{
+	float lo = x0 < x1 ? x0 : x1, hi = x0 < x1 ? x1 : x0, t;
+
+	if (lo >= width) return;
+	if (hi <= 0) {
+		cover[0] += d;
+		return;
+	}
+	if (lo < 0) {
+		t = -lo / (hi - lo);
+		cover[0] += d * t;
+		d -= d * t;
+		lo = 0;
+	}
+	if (hi > width) {
+		t = (hi - width) / (hi - lo);
+		d -= d * t;
+		hi = (float)width;
+	}
+	nsvg__accumulateLine(cover, lo, hi, d);
+}
+
+// Fills the sorted edges like nsvg__rasterizeSortedEdges(), a pixel row at a
+// time. The part of each edge in a row adds its signed area to the coverage
+// buffer, and a running sum over the row turns that into the coverage of
+// each pixel, which the fill rule then maps to 0..1.
+static void nsvg__rasterizeAnalytic(NSVGrasterizer *r, float tx, float ty, float scale, NSVGcachedPaint* cache, char fillRule)
+{
+	const float toPixels = 1.0f / NSVG__SUBSAMPLES;
+	NSVGcoverEdge* active;
+	NSVGcoverEdge* z;
+	NSVGedge* edge;
+	float* cover;
+	float ymax, top, bottom, sum, a;
+	unsigned char c;
+	int nactive = 0;
+	int i, j, x, y, e = 0;
+	int xmin, xmax, ystart, yend;
+
+	if (r->nedges > r->ccoverEdges) {
+		free(r->coverEdges);
+		r->ccoverEdges = r->nedges;
+		r->coverEdges = (NSVGcoverEdge*)malloc(sizeof(NSVGcoverEdge) * r->ccoverEdges);
+		if (r->coverEdges == NULL) {
+			r->ccoverEdges = 0;
+			return;
+		}
+	}
+	if (r->width + 2 > r->ccover) {
+		free(r->cover);
+		r->ccover = r->width + 2;
+		// Zeroed once, after that each row clears what it touched
+		r->cover = (float*)calloc(r->ccover, sizeof(float));
+		if (r->cover == NULL) {
+			r->ccover = 0;
+			return;
+		}
+	}
+	active = r->coverEdges;
+	cover = r->cover;
+
+	ymax = r->edges[0].y1;
+	for (i = 1; i < r->nedges; i++) {
+		if (r->edges[i].y1 > ymax)
+			ymax = r->edges[i].y1;
+	}
+	ystart = r->edges[0].y0 <= 0 ? 0 : (int)(r->edges[0].y0 * toPixels);
+	yend = ymax * toPixels >= r->height ? r->height : (int)ceilf(ymax * toPixels);
+
+	for (y = ystart; y < yend; y++) {
+		top = (float)y;
+		bottom = top + 1.0f;
+
+		// Drop the edges that ended above this row, add the ones starting in it
+		for (i = j = 0; i < nactive; i++) {
+			if (active[i].y1 > top)
+				active[j++] = active[i];
+		}
+		nactive = j;
+		while (e < r->nedges && r->edges[e].y0 * toPixels < bottom) {
+			edge = &r->edges[e++];
+			z = &active[nactive];
+			z->y0 = edge->y0 * toPixels;
+			z->y1 = edge->y1 * toPixels;
+			if (z->y1 <= top) continue;
+			z->x0 = edge->x0;
+			z->dxdy = (edge->x1 - edge->x0) / (z->y1 - z->y0);
+			z->dir = (float)edge->dir;
+			nactive++;
+		}
+
+		xmin = r->width + 1;
+		xmax = 0;
+		for (i = 0; i < nactive; i++) {
+			float y0, y1, x0, x1;
+			z = &active[i];
+			y0 = z->y0 > top ? z->y0 : top;
+			y1 = z->y1 < bottom ? z->y1 : bottom;
+			if (y1 <= y0) continue;
+			x0 = z->x0 + (y0 - z->y0) * z->dxdy;
+			x1 = z->x0 + (y1 - z->y0) * z->dxdy;
+			nsvg__accumulateClipped(cover, r->width, x0, x1, (y1 - y0) * z->dir);
+			// Track the span of cover written to, up to one past the line
+			if (x0 > x1) {
+				float t = x0; x0 = x1; x1 = t;
+			}
+			x = x0 <= 0 ? 0 : (x0 >= r->width ? r->width : (int)x0);
+			if (x < xmin) xmin = x;
+			x = x1 <= 0 ? 0 : (x1 >= r->width ? r->width+1 : (int)ceilf(x1)+1);
+			if (x > xmax) xmax = x;
+		}
+		if (xmin > xmax) continue;
+
+		// Sum up the coverage, clearing the buffer behind. Between edges it
+		// stays the same, so only pixels with an edge need converting.
+		sum = 0;
+		c = 0;
+		for (x = xmin; x <= xmax && x < r->width; x++) {
+			if (cover[x] != 0) {
+				sum += cover[x];
+				cover[x] = 0;
+				a = nsvg__absf(sum);
+				if (fillRule == NSVG_FILLRULE_EVENODD) {
+					a -= 2.0f * floorf(a * 0.5f);
+					if (a > 1.0f) a = 2.0f - a;
+				} else if (a > 1.0f) {
+					a = 1.0f;
+				}
+				c = (unsigned char)(a * 255.0f + 0.5f);
+			}
+			r->scanline[x] = c;
+		}
+		for (; x <= xmax; x++)
+			cover[x] = 0;
+
+		// Blit
+		if (xmax > r->width-1) xmax = r->width-1;
+		if (xmin <= xmax) {
+			if (r->bpp == 1)
+				nsvg__scanlineMask(&r->bitmap[y * r->stride] + xmin, xmax-xmin+1, &r->scanline[xmin], cache);
+			else
+				nsvg__scanlineSolid(r, &r->bitmap[y * r->stride] + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scale, cache);
 		}
 	}
 }
 
 static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r, float tx, float ty, float scale, NSVGcachedPaint* cache, char fillRule)
 {
-	NSVGactiveEdge *active = NULL;
-	int y, s;
+	NSVGactiveEdge *active, *added, z;
+	int nactive = 0, nadded;
+	int y, s, i, j, k;
 	int e = 0;
 	int maxWeight = (255 / NSVG__SUBSAMPLES);  // weight per vertical scanline
 	int xmin, xmax;
+	int ystart, yend;
+	float ymax;
+
+	if (r->nedges == 0) return;
+
+	if (r->flags & NSVG_RAST_ANALYTIC) {
+		nsvg__rasterizeAnalytic(r, tx, ty, scale, cache, fillRule);
+		return;
+	}
+
+	// At most every edge is active at once, so size for that up front
+	if (r->nedges > r->cactive) {
+		free(r->active);
+		free(r->added);
+		r->cactive = r->nedges;
+		r->active = (NSVGactiveEdge*)malloc(sizeof(NSVGactiveEdge) * r->cactive);
+		r->added = (NSVGactiveEdge*)malloc(sizeof(NSVGactiveEdge) * r->cactive);
+		if (r->active == NULL || r->added == NULL) {
+			r->cactive = 0;
+			return;
+		}
+	}
+	active = r->active;
+	added = r->added;
+
+	// Only sweep the rows the edges span. The edges are sorted by y0, so the
+	// first one starts the sweep, nothing can be active after the last y1.
+	ymax = r->edges[0].y1;
+	for (e = 1; e < r->nedges; e++) {
+		if (r->edges[e].y1 > ymax)
+			ymax = r->edges[e].y1;
+	}
+	e = 0;
+	ystart = r->edges[0].y0 <= 0 ? 0 : (int)(r->edges[0].y0 / NSVG__SUBSAMPLES);
+	yend = ymax / NSVG__SUBSAMPLES >= r->height ? r->height : (int)(ymax / NSVG__SUBSAMPLES) + 1;
+
+	// Clear the scanline once, after that each row clears what it touched
+	memset(r->scanline, 0, r->width);
 
-	for (y = 0; y < r->height; y++) {
-		memset(r->scanline, 0, r->width);
+	for (y = ystart; y < yend; y++) {
 		xmin = r->width;
 		xmax = 0;
 		for (s = 0; s < NSVG__SUBSAMPLES; ++s) {
 			// find center of pixel for this scanline
 			float scany = (float)(y*NSVG__SUBSAMPLES + s) + 0.5f;
-			NSVGactiveEdge **step = &active;
 
 			// update all active edges;
 			// remove all active edges that terminate before the center of this scanline
-			while (*step) {
-				NSVGactiveEdge *z = *step;
-				if (z->ey <= scany) {
-					*step = z->next; // delete from list
-//					NSVG__assert(z->valid);
-					nsvg__freeActive(r, z);
-				} else {
-					z->x += z->dx; // advance to position for current scanline
-					step = &((*step)->next); // advance through list
+			for (i = j = 0; i < nactive; i++) {
+				if (active[i].ey > scany) {
+					active[j] = active[i];
+					active[j].x += active[j].dx; // advance to position for current scanline
+					j++;
 				}
 			}
-
-			// resort the list if needed
-			for (;;) {
-				int changed = 0;
-				step = &active;
-				while (*step && (*step)->next) {
-					if ((*step)->x > (*step)->next->x) {
-						NSVGactiveEdge* t = *step;
-						NSVGactiveEdge* q = t->next;
-						t->next = q->next;
-						q->next = t;
-						*step = q;
-						changed = 1;
-					}
-					step = &(*step)->next;
-				}
-				if (!changed) break;
+			nactive = j;
+
+			// resort the array, edges only move a little from one scanline to
+			// the next so insertion sort does next to no work
+			for (i = 1; i < nactive; i++) {
+				z = active[i];
+				for (j = i; j > 0 && active[j-1].x > z.x; j--)
+					active[j] = active[j-1];
+				active[j] = z;
 			}
 
 			// insert all edges that start before the center of this scanline -- omit ones that also end on this scanline
+			// sort them into their own array first, then merge that into the active ones in one go
+			nadded = 0;
 			while (e < r->nedges && r->edges[e].y0 <= scany) {
 				if (r->edges[e].y1 > scany) {
-					NSVGactiveEdge* z = nsvg__addActive(r, &r->edges[e], scany);
-					if (z == NULL) break;
-					// find insertion point
-					if (active == NULL) {
-						active = z;
-					} else if (z->x < active->x) {
-						// insert at front
-						z->next = active;
-						active = z;
-					} else {
-						// find thing to insert AFTER
-						NSVGactiveEdge* p = active;
-						while (p->next && p->next->x < z->x)
-							p = p->next;
-						// at this point, p->next->x is NOT < z->x
-						z->next = p->next;
-						p->next = z;
-					}
+					nsvg__initActive(&z, &r->edges[e], scany);
+					// find insertion point, before anything that is NOT < z.x
+					for (j = nadded; j > 0 && added[j-1].x >= z.x; j--)
+						added[j] = added[j-1];
+					added[j] = z;
+					nadded++;
 				}
 				e++;
 			}
+			// merge from the back, new edges go before active ones at the same x
+			i = nactive - 1;
+			j = nadded - 1;
+			for (k = nactive + nadded - 1; j >= 0; k--) {
+				if (i >= 0 && active[i].x >= added[j].x)
+					active[k] = active[i--];
+				else
+					active[k] = added[j--];
+			}
+			nactive += nadded;
 
 			// now process all active edges in non-zero fashion
-			if (active != NULL)
-				nsvg__fillActiveEdges(r->scanline, r->width, active, maxWeight, &xmin, &xmax, fillRule);
+			if (nactive > 0)
+				nsvg__fillActiveEdges(r->scanline, r->width, active, nactive, maxWeight, &xmin, &xmax, fillRule);
 		}
 		// Blit
 		if (xmin < 0) xmin = 0;
 		if (xmax > r->width-1) xmax = r->width-1;
 		if (xmin <= xmax) {
-			nsvg__scanlineSolid(&r->bitmap[y * r->stride] + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scale, cache);
+			if (r->bpp == 1)
+				nsvg__scanlineMask(&r->bitmap[y * r->stride] + xmin, xmax-xmin+1, &r->scanline[xmin], cache);
+			else
+				nsvg__scanlineSolid(r, &r->bitmap[y * r->stride] + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scale, cache);
+			memset(&r->scanline[xmin], 0, xmax-xmin+1);
 		}
 	}
 
@@ -1368,16 +2041,32 @@ static void dumpEdges(NSVGrasterizer* r, const char* name)
 }
 */
 
-void nsvgRasterizeText(NSVGrasterizer* r,
-				   const NSVGimage* font, float tx, float ty, float scale,
-				   unsigned char* dst, int w, int h, int stride,
-				   const char* text)
+typedef struct NSVGglyphPos {
+	NSVGshape* shape;
+	float x, y;
+} NSVGglyphPos;
+
+// Scale and translate edges from first onwards to a glyph's position
+static void nsvg__translateEdges(NSVGrasterizer* r, int first, float tx, float ty)
+{
+	NSVGedge* e;
+	int i;
+
+	for (i = first; i < r->nedges; i++) {
+		e = &r->edges[i];
+		e->x0 = tx + e->x0;
+		e->y0 = (ty + e->y0) * NSVG__SUBSAMPLES;
+		e->x1 = tx + e->x1;
+		e->y1 = (ty + e->y1) * NSVG__SUBSAMPLES;
+	}
+}
+
+// Lay out text, returns the number of glyphs to draw
+static int nsvg__placeGlyphs(const NSVGimage* font, float tx, float ty, float scale,
+							 int h, const char* text, NSVGglyphPos* glyphs)
 {
 	NSVGshape *shape = NULL;
-	NSVGedge *e = NULL;
-	NSVGcachedPaint cache;
-	NSVGshape **shapes = nsvgGetTextShapes(font, text, strlen(text));
-	int i = 0, j = 0, textLen = strlen(text);
+	int i = 0, n = 0, len, textLen = strlen(text);
 	int fontHeight = (font->fontAscent - font->fontDescent) * scale;
 	int xStart = tx;
 	int charWidth = font->defaultHorizAdv * scale;
@@ -1386,104 +2075,279 @@ void nsvgRasterizeText(NSVGrasterizer* r,
 	// need to go DOWN every line
 	ty = ty + h - fontHeight;
 
-	r->bitmap = dst;
-	r->width = w;
-	r->height = h;
-	r->stride = stride;
-
-	if (w > r->cscanline) {
-		r->cscanline = w;
-		r->scanline = (unsigned char*)realloc(r->scanline, w);
-		if (r->scanline == NULL) {
-			return;
-		}
-	}
-
-	for (i = 0; i < h; i++) {
-		memset(&dst[i*stride], 0, w*4);
-	}
-
-	for (i = 0; i < textLen; i++) {
+	for (i = 0; i < textLen; i += len) {
+		len = 1;
 		if (text[i] == '\n') {
 			ty -= fontHeight;
-			// No clue why this is needed
-			tx = xStart - charWidth;
+			tx = xStart;
 			continue;
 		}
-		shape = shapes[i];
-		if (!shape) {
-			if (text[i] == ' ')
-				tx += charWidth / 2.f;
+		if (text[i] == ' ') {
+			tx += charWidth / 2.f;
 			continue;
 		}
-		if (!(shape->flags & NSVG_FLAGS_VISIBLE))
+		shape = nsvgGetTextGlyph(font, &text[i], textLen - i, &len);
+		if (!shape || !(shape->flags & NSVG_FLAGS_VISIBLE))
 			continue;
 
-		if (i == 0 && strcmp(shape->id, "OpenSansRegular") == 0)
-			tx = xStart - charWidth;
+		glyphs[n].shape = shape;
+		glyphs[n].x = tx;
+		glyphs[n].y = ty;
+		n++;
 
-		if (shape->fill.type != NSVG_PAINT_NONE) {
-			nsvg__resetPool(r);
-			shape->fill.color = 0xffffffff;
-			r->freelist = NULL;
-			r->nedges = 0;
+		tx += shape->horizAdvX * scale;
+	}
 
-			nsvg__flattenShape(r, shape, scale);
+	return n;
+}
 
-			// Scale and translate edges
-			for (j = 0; j < r->nedges; j++) {
-				e = &r->edges[j];
-				e->x0 = tx + e->x0;
-				e->y0 = (ty + e->y0) * NSVG__SUBSAMPLES;
-				e->x1 = tx + e->x1;
-				e->y1 = (ty + e->y1) * NSVG__SUBSAMPLES;
-			}
+static int nsvg__useGlyphCache(NSVGrasterizer* r)
+{
+	return r->bpp == 1 && (r->flags & NSVG_RAST_TEXT_GLYPH_CACHE);
+}
 
-			// Rasterize edges
-			qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+// Whether a glyph's fill goes into the shared edge list in single pass mode,
+// which is painted opaque, so translucent glyphs keep their own pass
+static int nsvg__mergeGlyphFill(NSVGrasterizer* r, NSVGshape* shape)
+{
+	return (r->flags & NSVG_RAST_TEXT_SINGLE_PASS) &&
+		!nsvg__useGlyphCache(r) &&
+		shape->fill.type != NSVG_PAINT_NONE &&
+		shape->fillRule == NSVG_FILLRULE_NONZERO &&
+		shape->opacity == 1.0f;
+}
 
-			// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
-			nsvg__initPaint(&cache, &shape->fill, shape->opacity);
+// Rasterizes the stroke and, if fill is set, the fill of a glyph at tx,ty
+static void nsvg__rasterizeGlyph(NSVGrasterizer* r, NSVGshape* shape,
+								 float tx, float ty, float scale, int fill)
+{
+	NSVGcachedPaint cache;
+	NSVGpaint white;
 
-			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, shape->fillRule);
+	white.type = NSVG_PAINT_COLOR;
+	white.color = 0xffffffff;
+
+	if (fill && shape->fill.type != NSVG_PAINT_NONE) {
+		r->nedges = 0;
+
+		nsvg__flattenShape(r, shape, scale);
+		nsvg__translateEdges(r, 0, tx, ty);
+
+		// Rasterize edges
+		nsvg__sortEdges(r);
+
+		// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
+		nsvg__initPaint(&cache, &white, shape->opacity);
+
+		nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, shape->fillRule);
+	}
+	if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f) {
+		r->nedges = 0;
+
+		nsvg__flattenShapeStroke(r, shape, scale);
+
+//		dumpEdges(r, "edge.svg");
+
+		nsvg__translateEdges(r, 0, tx, ty);
+
+		// Rasterize edges
+		nsvg__sortEdges(r);
+
+		// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
+		nsvg__initPaint(&cache, &shape->stroke, shape->opacity);
+
+		nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, NSVG_FILLRULE_NONZERO);
+	}
+}
+
+// Returns the cached coverage of shape at scale and subpixel offset fx,fy,
+// rasterizing it first if this is the first time it is drawn like this.
+static NSVGcachedGlyph* nsvg__getCachedGlyph(NSVGrasterizer* r, NSVGshape* shape,
+											 float scale, int fx, int fy)
+{
+	unsigned int hash = (unsigned int)(((size_t)shape >> 4) * 31 + fx * 7 + fy) % NSVG__GLYPH_BUCKETS;
+	unsigned char* bitmap = r->bitmap;
+	int width = r->width, height = r->height, stride = r->stride;
+	NSVGcachedGlyph* g;
+	float ox, oy, pad;
+
+	for (g = r->glyphs[hash]; g != NULL; g = g->next) {
+		if (g->shape == shape && g->scale == scale && g->fx == fx && g->fy == fy)
+			return g;
+	}
+
+	g = (NSVGcachedGlyph*)malloc(sizeof(NSVGcachedGlyph));
+	if (g == NULL) return NULL;
+
+	// Leave room for anti-aliasing, and for strokes and their joins
+	pad = 1.0f;
+	if (shape->stroke.type != NSVG_PAINT_NONE)
+		pad += shape->strokeWidth * scale * 0.5f * (shape->miterLimit > 1.0f ? shape->miterLimit : 1.0f);
+	ox = (float)fx / NSVG__GLYPH_SUBPIXELS;
+	oy = (float)fy / NSVG__GLYPH_SUBPIXELS;
+	g->shape = shape;
+	g->scale = scale;
+	g->fx = fx;
+	g->fy = fy;
+	g->x0 = (int)floorf(shape->bounds[0] * scale + ox - pad);
+	g->y0 = (int)floorf(shape->bounds[1] * scale + oy - pad);
+	g->w = (int)ceilf(shape->bounds[2] * scale + ox + pad) - g->x0;
+	g->h = (int)ceilf(shape->bounds[3] * scale + oy + pad) - g->y0;
+	g->mask = (unsigned char*)calloc(g->w, g->h);
+	if (g->mask == NULL) {
+		free(g);
+		return NULL;
+	}
+	if (g->w > r->cscanline) {
+		r->cscanline = g->w;
+		r->scanline = (unsigned char*)realloc(r->scanline, g->w);
+		if (r->scanline == NULL) {
+			r->cscanline = 0;
+			free(g->mask);
+			free(g);
+			return NULL;
 		}
-		if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f) {
-			nsvg__resetPool(r);
-			r->freelist = NULL;
-			r->nedges = 0;
+	}
 
-			nsvg__flattenShapeStroke(r, shape, scale);
+	r->bitmap = g->mask;
+	r->width = g->w;
+	r->height = g->h;
+	r->stride = g->w;
+	nsvg__rasterizeGlyph(r, shape, ox - g->x0, oy - g->y0, scale, 1);
+	r->bitmap = bitmap;
+	r->width = width;
+	r->height = height;
+	r->stride = stride;
 
-//			dumpEdges(r, "edge.svg");
+	g->next = r->glyphs[hash];
+	r->glyphs[hash] = g;
+	return g;
+}
 
-			// Scale and translate edges
-			for (j = 0; j < r->nedges; j++) {
-				e = &r->edges[j];
-				e->x0 = tx + e->x0;
-				e->y0 = (ty + e->y0) * NSVG__SUBSAMPLES;
-				e->x1 = tx + e->x1;
-				e->y1 = (ty + e->y1) * NSVG__SUBSAMPLES;
-			}
+// Composites the cached coverage of a glyph into the mask at x,y
+static void nsvg__drawCachedGlyph(NSVGrasterizer* r, NSVGshape* shape, float x, float y, float scale)
+{
+	float ix = floorf(x), iy = floorf(y);
+	int fx = (int)((x - ix) * NSVG__GLYPH_SUBPIXELS + 0.5f);
+	int fy = (int)((y - iy) * NSVG__GLYPH_SUBPIXELS + 0.5f);
+	NSVGcachedGlyph* g;
+	int i, j, x0, x1, y0, y1, xs, a;
+
+	// Rounding up to a whole pixel moves the origin instead
+	if (fx == NSVG__GLYPH_SUBPIXELS) { ix += 1; fx = 0; }
+	if (fy == NSVG__GLYPH_SUBPIXELS) { iy += 1; fy = 0; }
+
+	g = nsvg__getCachedGlyph(r, shape, scale, fx, fy);
+	if (g == NULL) return;
+
+	x0 = (int)ix + g->x0;
+	y0 = (int)iy + g->y0;
+	x1 = x0 + g->w < r->width ? x0 + g->w : r->width;
+	y1 = y0 + g->h < r->height ? y0 + g->h : r->height;
+
+	xs = x0 > 0 ? x0 : 0;
+	for (j = y0 > 0 ? y0 : 0; j < y1; j++) {
+		// Both start at column xs, so no pointer is formed outside its buffer
+		unsigned char* src = &g->mask[(j - y0) * g->w + (xs - x0)];
+		unsigned char* dst = &r->bitmap[j * r->stride + xs];
+		for (i = 0; i < x1 - xs; i++) {
+			if (src[i] == 0)
+				continue;
+			a = src[i];
+			dst[i] = (unsigned char)(a + nsvg__div255((255 - a) * (int)dst[i]));
+		}
+	}
+}
 
-			// Rasterize edges
-			qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+static void nsvg__rasterizeText(NSVGrasterizer* r,
+				   const NSVGimage* font, float tx, float ty, float scale,
+				   unsigned char* dst, int w, int h, int stride, int bpp,
+				   const char* text)
+{
+	NSVGshape *shape = NULL;
+	NSVGcachedPaint cache;
+	NSVGglyphPos* glyphs;
+	// Text is always drawn in white, whatever the font's glyphs say
+	NSVGpaint white;
+	int i = 0, nglyphs;
 
-			// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
-			nsvg__initPaint(&cache, &shape->stroke, shape->opacity);
+	white.type = NSVG_PAINT_COLOR;
+	white.color = 0xffffffff;
 
-			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, NSVG_FILLRULE_NONZERO);
+	r->bitmap = dst;
+	r->width = w;
+	r->height = h;
+	r->stride = stride;
+	r->bpp = bpp;
+
+	if (w > r->cscanline) {
+		r->cscanline = w;
+		r->scanline = (unsigned char*)realloc(r->scanline, w);
+		if (r->scanline == NULL) {
+			return;
 		}
-		tx += shape->horizAdvX * scale;
 	}
 
-	nsvg__unpremultiplyAlpha(dst, w, h, stride);
+	for (i = 0; i < h; i++) {
+		memset(&dst[i*stride], 0, w*bpp);
+	}
+
+	glyphs = (NSVGglyphPos*)malloc(sizeof(NSVGglyphPos) * (strlen(text) + 1));
+	if (glyphs == NULL) return;
+	nglyphs = nsvg__placeGlyphs(font, tx, ty, scale, h, text, glyphs);
+
+	if ((r->flags & NSVG_RAST_TEXT_SINGLE_PASS) && !nsvg__useGlyphCache(r)) {
+		r->nedges = 0;
+
+		// Collect the edges of all glyphs, then sort and sweep them once
+		for (i = 0; i < nglyphs; i++) {
+			int first = r->nedges;
+			if (!nsvg__mergeGlyphFill(r, glyphs[i].shape))
+				continue;
+			nsvg__flattenShape(r, glyphs[i].shape, scale);
+			nsvg__translateEdges(r, first, glyphs[i].x, glyphs[i].y);
+		}
+
+		nsvg__sortEdges(r);
+		nsvg__initPaint(&cache, &white, 1.0f);
+		nsvg__rasterizeSortedEdges(r, 0, 0, scale, &cache, NSVG_FILLRULE_NONZERO);
+	}
+
+	for (i = 0; i < nglyphs; i++) {
+		shape = glyphs[i].shape;
+		if (nsvg__useGlyphCache(r))
+			nsvg__drawCachedGlyph(r, shape, glyphs[i].x, glyphs[i].y, scale);
+		else
+			nsvg__rasterizeGlyph(r, shape, glyphs[i].x, glyphs[i].y, scale,
+								 !nsvg__mergeGlyphFill(r, shape));
+	}
 
-	free(shapes);
+	if (bpp == 4)
+		nsvg__unpremultiplyAlpha(dst, w, h, stride);
+
+	free(glyphs);
 
 	r->bitmap = NULL;
 	r->width = 0;
 	r->height = 0;
 	r->stride = 0;
+	r->bpp = 0;
+}
+
+void nsvgRasterizeText(NSVGrasterizer* r,
+				   const NSVGimage* font, float tx, float ty, float scale,
+				   unsigned char* dst, int w, int h, int stride,
+				   const char* text)
+{
+	nsvg__rasterizeText(r, font, tx, ty, scale, dst, w, h, stride, 4, text);
+}
+
+void nsvgRasterizeTextMask(NSVGrasterizer* r,
+				   const NSVGimage* font, float tx, float ty, float scale,
+				   unsigned char* dst, int w, int h, int stride,
+				   const char* text)
+{
+	nsvg__rasterizeText(r, font, tx, ty, scale, dst, w, h, stride, 1, text);
 }
 
 void nsvgRasterize(NSVGrasterizer* r,
@@ -1499,6 +2363,7 @@ void nsvgRasterize(NSVGrasterizer* r,
 	r->width = w;
 	r->height = h;
 	r->stride = stride;
+	r->bpp = 4;
 
 	if (w > r->cscanline) {
 		r->cscanline = w;
@@ -1514,8 +2379,6 @@ void nsvgRasterize(NSVGrasterizer* r,
 			continue;
 
 		if (shape->fill.type != NSVG_PAINT_NONE) {
-			nsvg__resetPool(r);
-			r->freelist = NULL;
 			r->nedges = 0;
 
 			nsvg__flattenShape(r, shape, scale);
@@ -1530,7 +2393,7 @@ void nsvgRasterize(NSVGrasterizer* r,
 			}
 
 			// Rasterize edges
-			qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+			nsvg__sortEdges(r);
 
 			// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
 			nsvg__initPaint(&cache, &shape->fill, shape->opacity);
@@ -1538,8 +2401,6 @@ void nsvgRasterize(NSVGrasterizer* r,
 			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, shape->fillRule);
 		}
 		if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f) {
-			nsvg__resetPool(r);
-			r->freelist = NULL;
 			r->nedges = 0;
 
 			nsvg__flattenShapeStroke(r, shape, scale);
@@ -1556,7 +2417,7 @@ void nsvgRasterize(NSVGrasterizer* r,
 			}
 
 			// Rasterize edges
-			qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+			nsvg__sortEdges(r);
 
 			// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
 			nsvg__initPaint(&cache, &shape->stroke, shape->opacity);
@@ -1571,6 +2432,7 @@ void nsvgRasterize(NSVGrasterizer* r,
 	r->width = 0;
 	r->height = 0;
 	r->stride = 0;
+	r->bpp = 0;
 }
 
 #endif
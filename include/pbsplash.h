@@ -1,8 +1,19 @@
 #ifndef __pbsplash_h__
 #define __pbsplash_h__
 
+#include <stdbool.h>
+#include <stdio.h>
+
 #define MM_TO_PX(dpi, mm) (dpi / 25.4) * (mm)
 
+extern bool debug;
+
+#define LOG(fmt, ...)                                                          \
+	do {                                                                   \
+		if (debug)                                                     \
+			printf(fmt, ##__VA_ARGS__);                            \
+	} while (0)
+
 struct col {
    union {
       unsigned int rgba;
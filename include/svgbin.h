@@ -0,0 +1,48 @@
+#ifndef __svgbin_h__
+#define __svgbin_h__
+
+#include <stdint.h>
+#include "nanosvg.h"
+
+/*
+ * Compiled images: an NSVGimage as it is in memory after parsing, with all
+ * pointers stored as offsets from the start of the file. Loading one is a
+ * single read and a pass over the pointers, instead of parsing XML.
+ *
+ * The layout is that of the nanosvg structures on the machine that wrote
+ * it, so files are only loaded on machines with the same byte order and
+ * structure sizes, and by the same format version. Coordinates are
+ * already scaled with the units and dpi given at compile time.
+ */
+
+#define SVGBIN_MAGIC "PBSVGBIN"
+/* Bump whenever the layout of the nanosvg structures changes */
+#define SVGBIN_VERSION 2
+
+struct svgbin_header {
+	char magic[8];
+	uint32_t version;
+	/* 0x01020304 as written by the compiler */
+	uint32_t byte_order;
+	uint16_t pointer_size;
+	uint16_t image_size;
+	uint16_t shape_size;
+	uint16_t path_size;
+	uint16_t gradient_size;
+	uint16_t reserved[3];
+	/* Of the whole file, header included */
+	uint64_t size;
+};
+
+/* Write image to path as a compiled image, returns 0 or a negative errno */
+int svgbin_write(const NSVGimage *image, const char *path);
+
+/*
+ * Load path, which is either a compiled image or an SVG file. SVG files
+ * are parsed with units and dpi, and if chars isn't NULL only the glyphs
+ * for chars are parsed (see nsvgParseFont()). Returns NULL on failure.
+ */
+NSVGimage *svgbin_load(const char *path, const char *units, float dpi,
+		       const char *chars);
+
+#endif
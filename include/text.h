@@ -0,0 +1,16 @@
+#ifndef __text_h__
+#define __text_h__
+
+#include "nanosvg.h"
+
+/*
+ * Get the dimensions of a string in pixels, based on the font size and the
+ * font SVG file. Lines wider than max_width are wrapped, preferably at a
+ * space. Returns the text with line breaks inserted, which the caller must
+ * free if it differs from text.
+ */
+const char *getTextDimensions(const NSVGimage *font, const char *text,
+			      float scale, int max_width, int *width,
+			      int *height);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __timing_h__
+#define __timing_h__
+
+#include <stdbool.h>
+
+/*
+ * Boot phase timing. Phases are measured with CLOCK_MONOTONIC from
+ * timing_init() until timing_report(), which prints them as a single
+ * key=value line so time-to-first-pixel can be tracked across boots.
+ */
+enum timing_phase {
+	TIMING_ARGS,
+	TIMING_FB_ACQUIRE,
+	TIMING_DPI_INFO,
+	TIMING_LOGO_PARSE,
+	TIMING_LOGO_RASTER,
+	TIMING_LOGO_BLIT,
+	TIMING_FONT_PARSE,
+	TIMING_MSG_LAYOUT,
+	TIMING_MSG_RENDER,
+	TIMING_FIRST_FLUSH,
+	TIMING_PHASE_COUNT,
+};
+
+void timing_init(void);
+/* A phase may be entered several times, the durations are summed */
+void timing_begin(enum timing_phase phase);
+void timing_end(enum timing_phase phase);
+/*
+ * Print the timings to stderr, and to the kernel log if kmsg is set, then
+ * stop recording.
+ */
+void timing_report(bool kmsg);
+
+#endif
@@ -1,10 +1,10 @@
 #include "pbsplash.h"
+#include "fb.h"
 #include <math.h>
 #include <stdio.h>
-#include <tfblib/tfb_colors.h>
-#include <tfblib/tfblib.h>
 
 struct col color = {.r = 255, .g = 255, .b = 255, .a = 255};
+static const struct col black = {.r = 0, .g = 0, .b = 0, .a = 255};
 
 #define PI	  3.1415926535897932384626433832795
 #define n_circles 3
@@ -12,7 +12,6 @@ struct col color = {.r = 255, .g = 255, .b = 255, .a = 255};
 
 static void circles_wave(int frame, int w, int y_off, long dpi)
 {
-	unsigned int t_col = tfb_make_color(color.r, color.g, color.b);
 	int f = round(frame * speed);
 
 	int rad = MM_TO_PX(dpi, 1);
@@ -24,10 +23,9 @@ static void circles_wave(int frame, int w, int y_off, long dpi)
 		int x = left + (i * dist);
 		double offset = sin(f / 60.0 * PI + i);
 		int y = y_off + offset * amplitude;
-		tfb_fill_rect(x - rad - 3, y_off - amplitude - rad - 3,
-			      rad * 2 + 6, amplitude * 2 + rad * 2 + 6,
-			      tfb_black);
-		tfb_fill_circle(x, y, rad, t_col);
+		fb_fill_rect(x - rad - 3, y_off - amplitude - rad - 3,
+			     rad * 2 + 6, amplitude * 2 + rad * 2 + 6, black);
+		fb_fill_circle(x, y, rad, color);
 	}
 }
 
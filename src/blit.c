@@ -0,0 +1,357 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "blit.h"
+
+void blit_row_xrgb8888_c(unsigned char *dst, const struct col *src,
+			 int count, struct col bg)
+{
+	unsigned int *out = (unsigned int *)dst;
+
+	for (int i = 0; i < count; i++) {
+		struct col c = src[i];
+		if (c.a == 0 || c.rgba == bg.rgba)
+			continue;
+		c = blit_blend(c, bg);
+		out[i] = c.r << 16 | c.g << 8 | c.b;
+	}
+}
+
+void blit_row_argb8888_c(unsigned char *dst, const struct col *src,
+			 int count, struct col bg)
+{
+	unsigned int *out = (unsigned int *)dst;
+
+	for (int i = 0; i < count; i++) {
+		struct col c = src[i];
+		if (c.a == 0 || c.rgba == bg.rgba)
+			continue;
+		c = blit_blend(c, bg);
+		out[i] = 0xff000000u | c.r << 16 | c.g << 8 | c.b;
+	}
+}
+
+void blit_row_rgb888_c(unsigned char *dst, const struct col *src, int count,
+		       struct col bg)
+{
+	for (int i = 0; i < count; i++, dst += 3) {
+		struct col c = src[i];
+		if (c.a == 0 || c.rgba == bg.rgba)
+			continue;
+		c = blit_blend(c, bg);
+		dst[0] = c.b;
+		dst[1] = c.g;
+		dst[2] = c.r;
+	}
+}
+
+void blit_row_rgb565_c(unsigned char *dst, const struct col *src, int count,
+		       struct col bg)
+{
+	unsigned short *out = (unsigned short *)dst;
+
+	for (int i = 0; i < count; i++) {
+		struct col c = src[i];
+		if (c.a == 0 || c.rgba == bg.rgba)
+			continue;
+		c = blit_blend(c, bg);
+		out[i] = (c.r >> 3) << 11 | (c.g >> 2) << 5 | c.b >> 3;
+	}
+}
+
+void blit_row_bgr565_c(unsigned char *dst, const struct col *src, int count,
+		       struct col bg)
+{
+	unsigned short *out = (unsigned short *)dst;
+
+	for (int i = 0; i < count; i++) {
+		struct col c = src[i];
+		if (c.a == 0 || c.rgba == bg.rgba)
+			continue;
+		c = blit_blend(c, bg);
+		out[i] = (c.b >> 3) << 11 | (c.g >> 2) << 5 | c.r >> 3;
+	}
+}
+
+/*
+ * Start of the next 8 byte block of mask with any coverage, looking from i
+ * on. Returns count if there is none. Text masks are mostly empty, this
+ * keeps the per-pixel loop away from the gaps between glyphs.
+ */
+static inline int mask_skip_empty(const unsigned char *mask, int i, int count)
+{
+	uint64_t v;
+
+	while (i + 8 <= count) {
+		memcpy(&v, mask + i, sizeof(v));
+		if (v)
+			break;
+		i += 8;
+	}
+
+	return i;
+}
+
+void blit_mask_row_32_c(unsigned char *dst, const unsigned char *mask,
+			int count, const unsigned int *lut)
+{
+	unsigned int *out = (unsigned int *)dst;
+
+	for (int i = mask_skip_empty(mask, 0, count); i < count;
+	     i = mask_skip_empty(mask, i, count)) {
+		for (int end = i + 8 < count ? i + 8 : count; i < end; i++) {
+			if (mask[i])
+				out[i] = lut[mask[i]];
+		}
+	}
+}
+
+void blit_mask_row_24_c(unsigned char *dst, const unsigned char *mask,
+			int count, const unsigned int *lut)
+{
+	for (int i = mask_skip_empty(mask, 0, count); i < count;
+	     i = mask_skip_empty(mask, i, count)) {
+		for (int end = i + 8 < count ? i + 8 : count; i < end; i++) {
+			unsigned int pixel = lut[mask[i]];
+
+			if (!mask[i])
+				continue;
+			dst[i * 3] = pixel;
+			dst[i * 3 + 1] = pixel >> 8;
+			dst[i * 3 + 2] = pixel >> 16;
+		}
+	}
+}
+
+void blit_mask_row_16_c(unsigned char *dst, const unsigned char *mask,
+			int count, const unsigned int *lut)
+{
+	unsigned short *out = (unsigned short *)dst;
+
+	for (int i = mask_skip_empty(mask, 0, count); i < count;
+	     i = mask_skip_empty(mask, i, count)) {
+		for (int end = i + 8 < count ? i + 8 : count; i < end; i++) {
+			if (mask[i])
+				out[i] = lut[mask[i]];
+		}
+	}
+}
+
+static bool bitfield_is(const struct fb_bitfield *f, int offset, int length)
+{
+	return f->offset == offset && f->length == length && !f->msb_right;
+}
+
+enum fb_format blit_format_from_var(const struct fb_var_screeninfo *var)
+{
+	if (var->grayscale || var->nonstd)
+		return FB_FORMAT_UNKNOWN;
+
+	switch (var->bits_per_pixel) {
+	case 32:
+		if (!bitfield_is(&var->red, 16, 8) ||
+		    !bitfield_is(&var->green, 8, 8) ||
+		    !bitfield_is(&var->blue, 0, 8))
+			break;
+		if (var->transp.length == 0)
+			return FB_FORMAT_XRGB8888;
+		if (bitfield_is(&var->transp, 24, 8))
+			return FB_FORMAT_ARGB8888;
+		break;
+	case 24:
+		if (bitfield_is(&var->red, 16, 8) &&
+		    bitfield_is(&var->green, 8, 8) &&
+		    bitfield_is(&var->blue, 0, 8))
+			return FB_FORMAT_RGB888;
+		break;
+	case 16:
+		if (!bitfield_is(&var->green, 5, 6))
+			break;
+		if (bitfield_is(&var->red, 11, 5) && bitfield_is(&var->blue, 0, 5))
+			return FB_FORMAT_RGB565;
+		if (bitfield_is(&var->blue, 11, 5) && bitfield_is(&var->red, 0, 5))
+			return FB_FORMAT_BGR565;
+		break;
+	}
+
+	return FB_FORMAT_UNKNOWN;
+}
+
+const char *blit_format_name(enum fb_format format)
+{
+	switch (format) {
+	case FB_FORMAT_XRGB8888:
+		return "XRGB8888";
+	case FB_FORMAT_ARGB8888:
+		return "ARGB8888";
+	case FB_FORMAT_RGB888:
+		return "RGB888";
+	case FB_FORMAT_RGB565:
+		return "RGB565";
+	case FB_FORMAT_BGR565:
+		return "BGR565";
+	default:
+		return "unknown";
+	}
+}
+
+int blit_format_bpp(enum fb_format format)
+{
+	switch (format) {
+	case FB_FORMAT_XRGB8888:
+	case FB_FORMAT_ARGB8888:
+		return 4;
+	case FB_FORMAT_RGB888:
+		return 3;
+	case FB_FORMAT_RGB565:
+	case FB_FORMAT_BGR565:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+enum fb_format blit_format_from_name(const char *name)
+{
+	for (int f = FB_FORMAT_XRGB8888; f <= FB_FORMAT_BGR565; f++) {
+		if (!strcasecmp(name, blit_format_name(f)))
+			return f;
+	}
+
+	return FB_FORMAT_UNKNOWN;
+}
+
+unsigned int blit_pack_color(enum fb_format format, struct col c)
+{
+	switch (format) {
+	case FB_FORMAT_XRGB8888:
+	case FB_FORMAT_RGB888:
+		return c.r << 16 | c.g << 8 | c.b;
+	case FB_FORMAT_ARGB8888:
+		return 0xff000000u | c.r << 16 | c.g << 8 | c.b;
+	case FB_FORMAT_RGB565:
+		return (c.r >> 3) << 11 | (c.g >> 2) << 5 | c.b >> 3;
+	case FB_FORMAT_BGR565:
+		return (c.b >> 3) << 11 | (c.g >> 2) << 5 | c.r >> 3;
+	default:
+		return 0;
+	}
+}
+
+struct col blit_unpack_color(enum fb_format format, const unsigned char *px)
+{
+	struct col c = { .a = 255 };
+	unsigned int v;
+
+	switch (format) {
+	case FB_FORMAT_XRGB8888:
+	case FB_FORMAT_ARGB8888:
+		v = *(const unsigned int *)px;
+		c.r = v >> 16;
+		c.g = v >> 8;
+		c.b = v;
+		break;
+	case FB_FORMAT_RGB888:
+		c.r = px[2];
+		c.g = px[1];
+		c.b = px[0];
+		break;
+	case FB_FORMAT_RGB565:
+	case FB_FORMAT_BGR565:
+		v = *(const unsigned short *)px;
+		c.r = (v >> 11) << 3 | (v >> 13);
+		c.g = ((v >> 5) & 0x3f) << 2 | ((v >> 9) & 0x3);
+		c.b = (v & 0x1f) << 3 | ((v >> 2) & 0x7);
+		if (format == FB_FORMAT_BGR565) {
+			unsigned char t = c.r;
+			c.r = c.b;
+			c.b = t;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return c;
+}
+
+const char *blit_isa_name(enum blit_isa isa)
+{
+	switch (isa) {
+	case BLIT_ISA_SSE2:
+		return "sse2";
+	case BLIT_ISA_AVX2:
+		return "avx2";
+	case BLIT_ISA_NEON:
+		return "neon";
+	default:
+		return "scalar";
+	}
+}
+
+enum blit_isa blit_best_isa(void)
+{
+	if (blit_simd_supported(BLIT_ISA_AVX2))
+		return BLIT_ISA_AVX2;
+	if (blit_simd_supported(BLIT_ISA_SSE2))
+		return BLIT_ISA_SSE2;
+	if (blit_simd_supported(BLIT_ISA_NEON))
+		return BLIT_ISA_NEON;
+	return BLIT_ISA_SCALAR;
+}
+
+blit_row_fn blit_get_row_fn_isa(enum fb_format format, enum blit_isa isa)
+{
+	if (isa != BLIT_ISA_SCALAR)
+		return blit_simd_get_row_fn(format, isa);
+
+	switch (format) {
+	case FB_FORMAT_XRGB8888:
+		return blit_row_xrgb8888_c;
+	case FB_FORMAT_ARGB8888:
+		return blit_row_argb8888_c;
+	case FB_FORMAT_RGB888:
+		return blit_row_rgb888_c;
+	case FB_FORMAT_RGB565:
+		return blit_row_rgb565_c;
+	case FB_FORMAT_BGR565:
+		return blit_row_bgr565_c;
+	default:
+		return NULL;
+	}
+}
+
+blit_row_fn blit_get_row_fn(enum fb_format format)
+{
+	blit_row_fn fn = blit_get_row_fn_isa(format, blit_best_isa());
+
+	// Not every format has a SIMD kernel for every ISA
+	if (!fn)
+		fn = blit_get_row_fn_isa(format, BLIT_ISA_SCALAR);
+	return fn;
+}
+
+void blit_tint_lut(enum fb_format format, struct col c, struct col bg,
+		   unsigned int lut[256])
+{
+	for (int i = 0; i < 256; i++) {
+		c.a = i;
+		lut[i] = blit_pack_color(format, blit_blend(c, bg));
+	}
+}
+
+blit_mask_row_fn blit_get_mask_row_fn(enum fb_format format)
+{
+	switch (blit_format_bpp(format)) {
+	case 4:
+		return blit_mask_row_32_c;
+	case 3:
+		return blit_mask_row_24_c;
+	case 2:
+		return blit_mask_row_16_c;
+	default:
+		return NULL;
+	}
+}
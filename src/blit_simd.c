@@ -0,0 +1,425 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "blit.h"
+
+/*
+ * SIMD versions of the blit kernels. Each block of pixels is classified
+ * first: blocks the scalar kernel would skip entirely are skipped, blocks
+ * it would write entirely are blended and packed in vector registers, and
+ * anything in between goes through the scalar kernel so the set of pixels
+ * written is exactly the same. The blend uses the same rounded division by
+ * 255 as blit_blend(), so the results match the scalar kernels bit for bit.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2"), always_inline)) static inline
+#define AVX2 __attribute__((target("avx2"), always_inline)) static inline
+
+/* Store ops to apply after blending, the format is a compile time constant */
+enum pack {
+	PACK_XRGB8888,
+	PACK_ARGB8888,
+	PACK_RGB565,
+	PACK_BGR565,
+};
+
+SSE2 __m128i sse2_div255(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/*
+ * Blend two pixels unpacked to 16 bit lanes over bg16 and reorder the
+ * channels from R,G,B,A to B,G,R,A so packing them back to bytes gives
+ * little endian XRGB words.
+ */
+SSE2 __m128i sse2_blend2(__m128i px, __m128i bg16)
+{
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xff), 0xff);
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(px, a),
+				  _mm_mullo_epi16(bg16, ia));
+
+	x = sse2_div255(x);
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+/* Turn blended XRGB words into 565, one per 32 bit lane */
+SSE2 __m128i sse2_to565(__m128i x, enum pack pack)
+{
+	__m128i g = _mm_and_si128(_mm_srli_epi32(x, 5), _mm_set1_epi32(0x07e0));
+
+	if (pack == PACK_RGB565)
+		return _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 8),
+						   _mm_set1_epi32(0xf800)),
+				     g),
+			_mm_and_si128(_mm_srli_epi32(x, 3),
+				      _mm_set1_epi32(0x001f)));
+	return _mm_or_si128(
+		_mm_or_si128(_mm_and_si128(_mm_slli_epi32(x, 8),
+					   _mm_set1_epi32(0xf800)),
+			     g),
+		_mm_and_si128(_mm_srli_epi32(x, 19), _mm_set1_epi32(0x001f)));
+}
+
+SSE2 void sse2_row(unsigned char *dst, const struct col *src, int count,
+		   struct col bg, enum pack pack, blit_row_fn scalar)
+{
+	const int bpp = pack == PACK_RGB565 || pack == PACK_BGR565 ? 2 : 4;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i amask = _mm_set1_epi32(0xff000000);
+	const __m128i bgv = _mm_set1_epi32(bg.rgba);
+	const __m128i bg16 = _mm_unpacklo_epi8(bgv, zero);
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i skip = _mm_or_si128(
+			_mm_cmpeq_epi32(_mm_and_si128(px, amask), zero),
+			_mm_cmpeq_epi32(px, bgv));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(skip));
+
+		if (mask == 0xf)
+			continue;
+		if (mask) {
+			scalar(dst + i * bpp, src + i, 4, bg);
+			continue;
+		}
+
+		__m128i out = _mm_packus_epi16(
+			sse2_blend2(_mm_unpacklo_epi8(px, zero), bg16),
+			sse2_blend2(_mm_unpackhi_epi8(px, zero), bg16));
+
+		switch (pack) {
+		case PACK_XRGB8888:
+			out = _mm_andnot_si128(amask, out);
+			_mm_storeu_si128((__m128i *)(dst + i * 4), out);
+			break;
+		case PACK_ARGB8888:
+			out = _mm_or_si128(amask, out);
+			_mm_storeu_si128((__m128i *)(dst + i * 4), out);
+			break;
+		case PACK_RGB565:
+		case PACK_BGR565:
+			out = sse2_to565(out, pack);
+			// Sign extend so the saturating pack keeps all 16 bits
+			out = _mm_srai_epi32(_mm_slli_epi32(out, 16), 16);
+			out = _mm_packs_epi32(out, out);
+			_mm_storel_epi64((__m128i *)(dst + i * 2), out);
+			break;
+		}
+	}
+
+	scalar(dst + i * bpp, src + i, count - i, bg);
+}
+
+AVX2 __m256i avx2_div255(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)),
+				 8);
+}
+
+/* As sse2_blend2(), for two pixels in each 128 bit lane */
+AVX2 __m256i avx2_blend2(__m256i px, __m256i bg16)
+{
+	__m256i a =
+		_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, 0xff), 0xff);
+	__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+	__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(px, a),
+				     _mm256_mullo_epi16(bg16, ia));
+
+	x = avx2_div255(x);
+	x = _mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2));
+	return _mm256_shufflehi_epi16(x, _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+AVX2 __m256i avx2_to565(__m256i x, enum pack pack)
+{
+	__m256i g = _mm256_and_si256(_mm256_srli_epi32(x, 5),
+				     _mm256_set1_epi32(0x07e0));
+
+	if (pack == PACK_RGB565)
+		return _mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_and_si256(_mm256_srli_epi32(x, 8),
+						 _mm256_set1_epi32(0xf800)),
+				g),
+			_mm256_and_si256(_mm256_srli_epi32(x, 3),
+					 _mm256_set1_epi32(0x001f)));
+	return _mm256_or_si256(
+		_mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(x, 8),
+						 _mm256_set1_epi32(0xf800)),
+				g),
+		_mm256_and_si256(_mm256_srli_epi32(x, 19),
+				 _mm256_set1_epi32(0x001f)));
+}
+
+AVX2 void avx2_row(unsigned char *dst, const struct col *src, int count,
+		   struct col bg, enum pack pack, blit_row_fn scalar)
+{
+	const int bpp = pack == PACK_RGB565 || pack == PACK_BGR565 ? 2 : 4;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i amask = _mm256_set1_epi32(0xff000000);
+	const __m256i bgv = _mm256_set1_epi32(bg.rgba);
+	const __m256i bg16 = _mm256_unpacklo_epi8(bgv, zero);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i skip = _mm256_or_si256(
+			_mm256_cmpeq_epi32(_mm256_and_si256(px, amask), zero),
+			_mm256_cmpeq_epi32(px, bgv));
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(skip));
+
+		if (mask == 0xff)
+			continue;
+		if (mask) {
+			scalar(dst + i * bpp, src + i, 8, bg);
+			continue;
+		}
+
+		// unpack and pack both work per 128 bit lane, so order is kept
+		__m256i out = _mm256_packus_epi16(
+			avx2_blend2(_mm256_unpacklo_epi8(px, zero), bg16),
+			avx2_blend2(_mm256_unpackhi_epi8(px, zero), bg16));
+
+		switch (pack) {
+		case PACK_XRGB8888:
+			out = _mm256_andnot_si256(amask, out);
+			_mm256_storeu_si256((__m256i *)(dst + i * 4), out);
+			break;
+		case PACK_ARGB8888:
+			out = _mm256_or_si256(amask, out);
+			_mm256_storeu_si256((__m256i *)(dst + i * 4), out);
+			break;
+		case PACK_RGB565:
+		case PACK_BGR565:
+			out = avx2_to565(out, pack);
+			out = _mm256_srai_epi32(_mm256_slli_epi32(out, 16), 16);
+			out = _mm256_packs_epi32(out, out);
+			// Gather the low quadword of each lane
+			out = _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i *)(dst + i * 2),
+					 _mm256_castsi256_si128(out));
+			break;
+		}
+	}
+
+	sse2_row(dst + i * bpp, src + i, count - i, bg, pack, scalar);
+}
+
+#define X86_KERNELS(name, pack)                                                \
+	__attribute__((target("sse2"))) static void blit_row_##name##_sse2(    \
+		unsigned char *dst, const struct col *src, int count,          \
+		struct col bg)                                                 \
+	{                                                                      \
+		sse2_row(dst, src, count, bg, pack, blit_row_##name##_c);      \
+	}                                                                      \
+	__attribute__((target("avx2"))) static void blit_row_##name##_avx2(    \
+		unsigned char *dst, const struct col *src, int count,          \
+		struct col bg)                                                 \
+	{                                                                      \
+		avx2_row(dst, src, count, bg, pack, blit_row_##name##_c);      \
+	}
+
+X86_KERNELS(xrgb8888, PACK_XRGB8888)
+X86_KERNELS(argb8888, PACK_ARGB8888)
+X86_KERNELS(rgb565, PACK_RGB565)
+X86_KERNELS(bgr565, PACK_BGR565)
+
+bool blit_simd_supported(enum blit_isa isa)
+{
+	__builtin_cpu_init();
+
+	switch (isa) {
+	case BLIT_ISA_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case BLIT_ISA_AVX2:
+		return __builtin_cpu_supports("avx2");
+	default:
+		return false;
+	}
+}
+
+/*
+ * RGB888 has no x86 kernel, without SSSE3 byte shuffles packing to three
+ * bytes per pixel isn't any faster than the scalar loop.
+ */
+blit_row_fn blit_simd_get_row_fn(enum fb_format format, enum blit_isa isa)
+{
+	if (!blit_simd_supported(isa))
+		return NULL;
+
+	switch (format) {
+	case FB_FORMAT_XRGB8888:
+		return isa == BLIT_ISA_AVX2 ? blit_row_xrgb8888_avx2
+					    : blit_row_xrgb8888_sse2;
+	case FB_FORMAT_ARGB8888:
+		return isa == BLIT_ISA_AVX2 ? blit_row_argb8888_avx2
+					    : blit_row_argb8888_sse2;
+	case FB_FORMAT_RGB565:
+		return isa == BLIT_ISA_AVX2 ? blit_row_rgb565_avx2
+					    : blit_row_rgb565_sse2;
+	case FB_FORMAT_BGR565:
+		return isa == BLIT_ISA_AVX2 ? blit_row_bgr565_avx2
+					    : blit_row_bgr565_sse2;
+	default:
+		return NULL;
+	}
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static inline uint8x16_t neon_blend(uint8x16_t c, uint8x16_t a, uint8x16_t ia,
+				    uint8x16_t bg)
+{
+	const uint16x8_t half = vdupq_n_u16(128);
+	uint16x8_t lo = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+	uint16x8_t hi = vmull_high_u8(c, a);
+
+	lo = vmlal_u8(lo, vget_low_u8(bg), vget_low_u8(ia));
+	hi = vmlal_high_u8(hi, bg, ia);
+	lo = vaddq_u16(lo, half);
+	hi = vaddq_u16(hi, half);
+	lo = vsraq_n_u16(lo, lo, 8);
+	hi = vsraq_n_u16(hi, hi, 8);
+	return vshrn_high_n_u16(vshrn_n_u16(lo, 8), hi, 8);
+}
+
+/* Pack 8 pixels to 565, hi is the channel going to the top bits */
+static inline uint16x8_t neon_565(uint16x8_t hi, uint16x8_t g, uint16x8_t lo)
+{
+	hi = vsriq_n_u16(hi, g, 5);
+	return vsriq_n_u16(hi, lo, 11);
+}
+
+static inline void neon_row(unsigned char *dst, const struct col *src,
+			    int count, struct col bg, enum fb_format format,
+			    blit_row_fn scalar)
+{
+	const int bpp = blit_format_bpp(format);
+	const uint8x16_t bgr = vdupq_n_u8(bg.r), bgg = vdupq_n_u8(bg.g);
+	const uint8x16_t bgb = vdupq_n_u8(bg.b), bga = vdupq_n_u8(bg.a);
+	int i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x4_t px = vld4q_u8((const uint8_t *)(src + i));
+		uint8x16_t isbg = vandq_u8(
+			vandq_u8(vceqq_u8(px.val[0], bgr),
+				 vceqq_u8(px.val[1], bgg)),
+			vandq_u8(vceqq_u8(px.val[2], bgb),
+				 vceqq_u8(px.val[3], bga)));
+		uint8x16_t skip = vorrq_u8(vceqzq_u8(px.val[3]), isbg);
+
+		if (vminvq_u8(skip))
+			continue;
+		if (vmaxvq_u8(skip)) {
+			scalar(dst + i * bpp, src + i, 16, bg);
+			continue;
+		}
+
+		uint8x16_t a = px.val[3], ia = vmvnq_u8(a);
+		uint8x16_t r = neon_blend(px.val[0], a, ia, bgr);
+		uint8x16_t g = neon_blend(px.val[1], a, ia, bgg);
+		uint8x16_t b = neon_blend(px.val[2], a, ia, bgb);
+
+		switch (format) {
+		case FB_FORMAT_XRGB8888:
+		case FB_FORMAT_ARGB8888: {
+			uint8x16x4_t out = { { b, g, r,
+					       vdupq_n_u8(format == FB_FORMAT_ARGB8888 ?
+								  0xff :
+								  0) } };
+			vst4q_u8(dst + i * 4, out);
+			break;
+		}
+		case FB_FORMAT_RGB888: {
+			uint8x16x3_t out = { { b, g, r } };
+			vst3q_u8(dst + i * 3, out);
+			break;
+		}
+		case FB_FORMAT_RGB565:
+		case FB_FORMAT_BGR565: {
+			uint8x16_t top = format == FB_FORMAT_RGB565 ? r : b;
+			uint8x16_t bot = format == FB_FORMAT_RGB565 ? b : r;
+			uint16_t *out = (uint16_t *)(dst + i * 2);
+
+			vst1q_u16(out, neon_565(vshll_n_u8(vget_low_u8(top), 8),
+						vshll_n_u8(vget_low_u8(g), 8),
+						vshll_n_u8(vget_low_u8(bot), 8)));
+			vst1q_u16(out + 8, neon_565(vshll_high_n_u8(top, 8),
+						    vshll_high_n_u8(g, 8),
+						    vshll_high_n_u8(bot, 8)));
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	scalar(dst + i * bpp, src + i, count - i, bg);
+}
+
+#define NEON_KERNEL(name, format)                                              \
+	static void blit_row_##name##_neon(unsigned char *dst,                 \
+					   const struct col *src, int count,   \
+					   struct col bg)                      \
+	{                                                                      \
+		neon_row(dst, src, count, bg, format, blit_row_##name##_c);    \
+	}
+
+NEON_KERNEL(xrgb8888, FB_FORMAT_XRGB8888)
+NEON_KERNEL(argb8888, FB_FORMAT_ARGB8888)
+NEON_KERNEL(rgb888, FB_FORMAT_RGB888)
+NEON_KERNEL(rgb565, FB_FORMAT_RGB565)
+NEON_KERNEL(bgr565, FB_FORMAT_BGR565)
+
+// NEON is mandatory on aarch64
+bool blit_simd_supported(enum blit_isa isa)
+{
+	return isa == BLIT_ISA_NEON;
+}
+
+blit_row_fn blit_simd_get_row_fn(enum fb_format format, enum blit_isa isa)
+{
+	if (!blit_simd_supported(isa))
+		return NULL;
+
+	switch (format) {
+	case FB_FORMAT_XRGB8888:
+		return blit_row_xrgb8888_neon;
+	case FB_FORMAT_ARGB8888:
+		return blit_row_argb8888_neon;
+	case FB_FORMAT_RGB888:
+		return blit_row_rgb888_neon;
+	case FB_FORMAT_RGB565:
+		return blit_row_rgb565_neon;
+	case FB_FORMAT_BGR565:
+		return blit_row_bgr565_neon;
+	default:
+		return NULL;
+	}
+}
+
+#else
+
+bool blit_simd_supported(enum blit_isa isa)
+{
+	return false;
+}
+
+blit_row_fn blit_simd_get_row_fn(enum fb_format format, enum blit_isa isa)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,442 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <tfblib/tfblib.h>
+#include <tfblib/tfb_colors.h>
+
+#include "fb.h"
+
+#define DEBUGRENDER 0
+
+/*
+ * fb.mem is the framebuffer memory if we can write to it directly, so
+ * fb_blit() can write whole rows instead of going through tfb_draw_pixel()
+ * for every single pixel. It is NULL if the framebuffer layout isn't one we
+ * have a blit kernel for, in which case we fall back to tfblib. In headless
+ * mode it is always set and owned by us.
+ */
+static struct {
+	bool headless;
+	unsigned char *mem;
+	size_t pitch;
+	int width, height;
+	int width_mm, height_mm;
+	int bpp;
+	enum fb_format format;
+	blit_row_fn blit_row;
+	blit_mask_row_fn blit_mask_row;
+} fb;
+
+int fb_parse_headless_spec(const char *spec, struct fb_headless_config *cfg)
+{
+	const char *fmt = strchr(spec, ':');
+	int n;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->format = FB_FORMAT_XRGB8888;
+
+	if (sscanf(spec, "%dx%d%n", &cfg->width, &cfg->height, &n) != 2)
+		return -EINVAL;
+	spec += n;
+	if (*spec == '@') {
+		if (sscanf(spec, "@%dx%d%n", &cfg->width_mm, &cfg->height_mm,
+			   &n) != 2)
+			return -EINVAL;
+		spec += n;
+	}
+	if (spec != fmt && *spec != '\0')
+		return -EINVAL;
+
+	if (fmt) {
+		cfg->format = blit_format_from_name(fmt + 1);
+		if (cfg->format == FB_FORMAT_UNKNOWN)
+			return -EINVAL;
+	}
+
+	if (cfg->width < 1 || cfg->height < 1 || cfg->width_mm < 0 ||
+	    cfg->height_mm < 0)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void fb_direct_init(const char *fb_path)
+{
+	struct fb_var_screeninfo var;
+	enum blit_isa isa;
+	int fd;
+
+	fb.mem = NULL;
+
+	if (!__fb_buffer || __fb_off_x || __fb_off_y)
+		return;
+
+	fd = open(fb_path, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (ioctl(fd, FBIOGET_VSCREENINFO, &var) < 0) {
+		close(fd);
+		return;
+	}
+	close(fd);
+
+	fb.format = blit_format_from_var(&var);
+	isa = blit_best_isa();
+	if (!blit_get_row_fn_isa(fb.format, isa))
+		isa = BLIT_ISA_SCALAR;
+	fb.blit_row = blit_get_row_fn_isa(fb.format, isa);
+	fb.blit_mask_row = blit_get_mask_row_fn(fb.format);
+	fb.bpp = blit_format_bpp(fb.format);
+	LOG("framebuffer format: %s (%d bpp), blit kernel: %s\n",
+	    blit_format_name(fb.format), var.bits_per_pixel,
+	    blit_isa_name(isa));
+	if (!fb.blit_row || __fb_pitch < (size_t)fb.width * fb.bpp)
+		return;
+
+	fb.mem = __fb_buffer;
+	fb.pitch = __fb_pitch;
+}
+
+int fb_acquire(const char *fb_path, const char *tty)
+{
+	int rc;
+
+	rc = tfb_acquire_fb(/*TFB_FL_NO_TTY_KD_GRAPHICS */ 0, fb_path, tty);
+	if (rc != TFB_SUCCESS)
+		return rc;
+
+	fb.headless = false;
+	fb.width = (int)tfb_screen_width();
+	fb.height = (int)tfb_screen_height();
+	fb.width_mm = (int)tfb_screen_width_mm();
+	fb.height_mm = (int)tfb_screen_height_mm();
+	fb_direct_init(fb_path);
+
+	return TFB_SUCCESS;
+}
+
+int fb_acquire_headless(const struct fb_headless_config *cfg)
+{
+	fb.headless = true;
+	fb.width = cfg->width;
+	fb.height = cfg->height;
+	fb.width_mm = cfg->width_mm;
+	fb.height_mm = cfg->height_mm;
+	fb.format = cfg->format;
+	fb.bpp = blit_format_bpp(cfg->format);
+	fb.blit_row = blit_get_row_fn(cfg->format);
+	fb.blit_mask_row = blit_get_mask_row_fn(cfg->format);
+	fb.pitch = (size_t)fb.width * fb.bpp;
+	if (!fb.blit_row)
+		return -EINVAL;
+
+	fb.mem = calloc(fb.height, fb.pitch);
+	if (!fb.mem)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void fb_release(void)
+{
+	if (fb.headless)
+		free(fb.mem);
+	else
+		tfb_release_fb();
+	fb.mem = NULL;
+}
+
+int fb_width(void)
+{
+	return fb.width;
+}
+
+int fb_height(void)
+{
+	return fb.height;
+}
+
+int fb_width_mm(void)
+{
+	return fb.width_mm;
+}
+
+int fb_height_mm(void)
+{
+	return fb.height_mm;
+}
+
+bool fb_is_headless(void)
+{
+	return fb.headless;
+}
+
+static void fill_span(unsigned char *dst, int count, unsigned int pixel)
+{
+	switch (fb.bpp) {
+	case 4:
+		for (int i = 0; i < count; i++)
+			((unsigned int *)dst)[i] = pixel;
+		break;
+	case 3:
+		for (int i = 0; i < count; i++, dst += 3) {
+			dst[0] = pixel;
+			dst[1] = pixel >> 8;
+			dst[2] = pixel >> 16;
+		}
+		break;
+	case 2:
+		for (int i = 0; i < count; i++)
+			((unsigned short *)dst)[i] = pixel;
+		break;
+	}
+}
+
+static inline unsigned int tfb_color(struct col c)
+{
+	return tfb_make_color(c.r, c.g, c.b);
+}
+
+void fb_clear(struct col c)
+{
+	if (fb.headless)
+		fb_fill_rect(0, 0, fb.width, fb.height, c);
+	else
+		tfb_clear_screen(tfb_color(c));
+}
+
+void fb_fill_rect(int x, int y, int w, int h, struct col c)
+{
+	unsigned int pixel;
+
+	if (!fb.headless) {
+		tfb_fill_rect(x, y, w, h, tfb_color(c));
+		return;
+	}
+
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > fb.width)
+		w = fb.width - x;
+	if (y + h > fb.height)
+		h = fb.height - y;
+	if (w <= 0 || h <= 0)
+		return;
+
+	pixel = blit_pack_color(fb.format, c);
+	for (int j = y; j < y + h; j++)
+		fill_span(fb.mem + j * fb.pitch + x * fb.bpp, w, pixel);
+}
+
+void fb_fill_circle(int cx, int cy, int r, struct col c)
+{
+	if (!fb.headless) {
+		tfb_fill_circle(cx, cy, r, tfb_color(c));
+		return;
+	}
+
+	for (int dy = -r; dy <= r; dy++) {
+		int dx = (int)sqrtf((float)(r * r - dy * dy));
+		fb_fill_rect(cx - dx, cy + dy, dx * 2 + 1, 1, c);
+	}
+}
+
+/*
+ * Row-major blit straight into framebuffer memory. Clipping and the
+ * framebuffer pixel layout are handled once per row, blending and packing
+ * happen in the format specific kernel picked at acquire time.
+ */
+static void blit_rows(const unsigned char *buf, int x, int y, int w, int h,
+		      bool vflip, struct col bg)
+{
+	int x0 = x < 0 ? -x : 0;
+	int x1 = x + w > fb.width ? fb.width - x : w;
+
+	if (x0 >= x1)
+		return;
+
+	for (int j = 0; j < h; j++) {
+		int dy = vflip ? y + h - j : y + j;
+		if (dy < 0 || dy >= fb.height)
+			continue;
+
+		fb.blit_row(fb.mem + dy * fb.pitch + (x + x0) * fb.bpp,
+			    (const struct col *)(buf + j * w * 4) + x0, x1 - x0,
+			    bg);
+	}
+}
+
+static void blit_pixels(const unsigned char *buf, int x, int y, int w, int h,
+			bool vflip, struct col bg)
+{
+	struct col prev_col = { .r = 0, .g = 0, .b = 0, .a = 0 };
+	unsigned int col = tfb_color(bg);
+
+	for (size_t i = 0; i < w; i++) {
+		for (size_t j = 0; j < h; j++) {
+			struct col rgba =
+				*(struct col *)(buf + (j * w + i) * 4);
+			if (rgba.a == 0 || rgba.rgba == bg.rgba)
+				continue;
+
+			rgba = blit_blend(rgba, bg);
+
+			// No need to generate the colour again if it's the same as the previous one
+			if (rgba.rgba != prev_col.rgba) {
+				prev_col.rgba = rgba.rgba;
+				col = tfb_color(rgba);
+			}
+			if (vflip)
+				tfb_draw_pixel(x + i, y + h - j, col);
+			else
+				tfb_draw_pixel(x + i, y + j, col);
+		}
+	}
+}
+
+void fb_blit(const unsigned char *buf, int x, int y, int w, int h, bool vflip,
+	     struct col bg)
+{
+	if (fb.mem)
+		blit_rows(buf, x, y, w, h, vflip, bg);
+	else
+		blit_pixels(buf, x, y, w, h, vflip, bg);
+
+#if DEBUGRENDER == 1
+	struct col red = { .r = 255, .g = 0, .b = 0, .a = 255 };
+	int top = vflip ? y + 1 : y;
+
+	fb_fill_rect(x, top, w, 1, red);
+	fb_fill_rect(x, top + h - 1, w, 1, red);
+	fb_fill_rect(x, top, 1, h, red);
+	fb_fill_rect(x + w - 1, top, 1, h, red);
+#endif
+}
+
+static void blit_mask_rows(const unsigned char *mask, int x, int y, int w,
+			   int h, bool vflip, struct col c, struct col bg)
+{
+	int x0 = x < 0 ? -x : 0;
+	int x1 = x + w > fb.width ? fb.width - x : w;
+	unsigned int lut[256];
+
+	if (x0 >= x1)
+		return;
+
+	blit_tint_lut(fb.format, c, bg, lut);
+	for (int j = 0; j < h; j++) {
+		int dy = vflip ? y + h - j : y + j;
+		if (dy < 0 || dy >= fb.height)
+			continue;
+
+		fb.blit_mask_row(fb.mem + dy * fb.pitch + (x + x0) * fb.bpp,
+				 mask + j * w + x0, x1 - x0, lut);
+	}
+}
+
+static void blit_mask_pixels(const unsigned char *mask, int x, int y, int w,
+			     int h, bool vflip, struct col c, struct col bg)
+{
+	unsigned int lut[256];
+
+	// tfblib packs the colour itself, so the table only saves the blending
+	for (int i = 0; i < 256; i++) {
+		c.a = i;
+		lut[i] = tfb_color(blit_blend(c, bg));
+	}
+
+	for (size_t j = 0; j < h; j++) {
+		for (size_t i = 0; i < w; i++) {
+			unsigned char m = mask[j * w + i];
+			if (!m)
+				continue;
+
+			if (vflip)
+				tfb_draw_pixel(x + i, y + h - j, lut[m]);
+			else
+				tfb_draw_pixel(x + i, y + j, lut[m]);
+		}
+	}
+}
+
+void fb_blit_mask(const unsigned char *mask, int x, int y, int w, int h,
+		  bool vflip, struct col c, struct col bg)
+{
+	if (fb.mem)
+		blit_mask_rows(mask, x, y, w, h, vflip, c, bg);
+	else
+		blit_mask_pixels(mask, x, y, w, h, vflip, c, bg);
+}
+
+void fb_flush(void)
+{
+	if (fb.headless)
+		return;
+
+	tfb_flush_window();
+	tfb_flush_fb();
+}
+
+int fb_dump(const char *path)
+{
+	size_t len = strlen(path);
+	bool pam = len >= 4 && !strcmp(path + len - 4, ".pam");
+	unsigned char *row;
+	int ret = 0;
+	FILE *fp;
+
+	if (!fb.mem)
+		return -ENOTSUP;
+
+	fp = fopen(path, "wb");
+	if (!fp)
+		return -errno;
+
+	if (pam)
+		fprintf(fp,
+			"P7\nWIDTH %d\nHEIGHT %d\nDEPTH 3\nMAXVAL 255\n"
+			"TUPLTYPE RGB\nENDHDR\n",
+			fb.width, fb.height);
+	else
+		fprintf(fp, "P6\n%d %d\n255\n", fb.width, fb.height);
+
+	row = malloc(fb.width * 3);
+	if (!row) {
+		fclose(fp);
+		return -ENOMEM;
+	}
+	for (int j = 0; j < fb.height; j++) {
+		const unsigned char *src = fb.mem + j * fb.pitch;
+		for (int i = 0; i < fb.width; i++, src += fb.bpp) {
+			struct col c = blit_unpack_color(fb.format, src);
+			row[i * 3] = c.r;
+			row[i * 3 + 1] = c.g;
+			row[i * 3 + 2] = c.b;
+		}
+		if (fwrite(row, 3, fb.width, fp) != (size_t)fb.width) {
+			ret = errno ? -errno : -EIO;
+			break;
+		}
+	}
+	free(row);
+
+	if (ret) {
+		fclose(fp);
+		return ret;
+	}
+	if (fclose(fp))
+		return -errno;
+
+	return 0;
+}
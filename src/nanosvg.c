@@ -2,6 +2,7 @@
  * C files build fast during development. */
 #include <stdio.h>
 
+#define NANOSVG_ALL_COLOR_KEYWORDS // Include full list of color keywords.
 #define NANOSVG_IMPLEMENTATION
 #include "nanosvg.h"
 
@@ -0,0 +1,71 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "nanosvg.h"
+#include "svgbin.h"
+
+// Used by the pbsplash library for logging
+bool debug = false;
+
+static int usage()
+{
+	// clang-format off
+	fprintf(stderr, "pbsplash-compile: compile an SVG image or font for pbsplash\n");
+	fprintf(stderr, "-----------------------------------------------------------\n");
+	fprintf(stderr, "pbsplash-compile [-h] [-u units] [-d dpi] input.svg output\n\n");
+	fprintf(stderr, "    -h           show this help\n");
+	fprintf(stderr, "    -u           units to parse with (default: px)\n");
+	fprintf(stderr, "    -d           dpi to parse with (default: 96)\n\n");
+	fprintf(stderr, "pbsplash loads the output anywhere it takes an SVG file. Use the\n");
+	fprintf(stderr, "defaults for logos and fonts, pbsplash scales both itself.\n");
+	// clang-format on
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *units = "px";
+	float dpi = 96;
+	NSVGimage *image;
+	char *end;
+	int optflag, ret;
+
+	while ((optflag = getopt(argc, argv, "hu:d:")) != -1) {
+		switch (optflag) {
+		case 'u':
+			units = optarg;
+			break;
+		case 'd':
+			dpi = strtof(optarg, &end);
+			if (end == optarg || dpi <= 0) {
+				fprintf(stderr, "Invalid dpi: %s\n", optarg);
+				return usage();
+			}
+			break;
+		default:
+			return usage();
+		}
+	}
+
+	if (argc - optind != 2)
+		return usage();
+
+	image = nsvgParseFromFile(argv[optind], units, dpi);
+	if (!image) {
+		fprintf(stderr, "failed to parse %s\n", argv[optind]);
+		return 1;
+	}
+
+	ret = svgbin_write(image, argv[optind + 1]);
+	nsvgDelete(image);
+	if (ret < 0) {
+		fprintf(stderr, "failed to write %s: %s\n", argv[optind + 1],
+			strerror(-ret));
+		return 1;
+	}
+
+	return 0;
+}
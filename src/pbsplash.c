@@ -8,16 +8,17 @@
 #include <sys/ioctl.h>
 #include <linux/kd.h>
 #include <fcntl.h>
-#include <tfblib/tfblib.h>
-#include <tfblib/tfb_colors.h>
 
 #include <string.h>
 #include <math.h>
-#define NANOSVG_ALL_COLOR_KEYWORDS // Include full list of color keywords.
 #include "nanosvg.h"
 #include "nanosvgrast.h"
 #include "timespec.h"
 #include "pbsplash.h"
+#include "svgbin.h"
+#include "fb.h"
+#include "text.h"
+#include "timing.h"
 
 #define MSG_MAX_LEN	  4096
 #define DEFAULT_FONT_PATH "/usr/share/pbsplash/OpenSans-Regular.svg"
@@ -28,23 +29,18 @@
 #define PT_TO_MM	  0.38f
 #define TTY_PATH_LEN	  11
 
-#define DEBUGRENDER	  0
-
 volatile sig_atomic_t terminate = 0;
 
 bool debug = false;
 struct col background_color = { .r = 0, .g = 0, .b = 0, .a = 255 };
+struct col text_color = { .r = 255, .g = 255, .b = 255, .a = 255 };
 
 static int screenWidth, screenHeight;
+/* Extra NSVGrasterizerFlags for the logo and the messages */
+static int rast_flags;
 
 #define zalloc(size) calloc(1, size)
 
-#define LOG(fmt, ...)                                                          \
-	do {                                                                   \
-		if (debug)                                                     \
-			printf(fmt, ##__VA_ARGS__);                            \
-	} while (0)
-
 static int usage()
 {
 	// clang-format off
@@ -52,11 +48,13 @@ static int usage()
 	fprintf(stderr, "-------------------------------------------\n");
 	fprintf(stderr, "pbsplash [-v] [-h] [-f font] [-s splash image] [-m message]\n");
 	fprintf(stderr, "         [-b message bottom] [-o font size bottom]\n");
-	fprintf(stderr, "         [-p font size] [-q max logo size] [-d] [-e]\n\n");
+	fprintf(stderr, "         [-p font size] [-q max logo size] [-d] [-e]\n");
+	fprintf(stderr, "         [-H WxH[@WmmxHmm][:format]] [-O dump path] [-k] [-a]\n\n");
 	fprintf(stderr, "    -v           enable verbose logging\n");
 	fprintf(stderr, "    -h           show this help\n");
 	fprintf(stderr, "    -f           path to SVG font file (default: %s)\n", DEFAULT_FONT_PATH);
 	fprintf(stderr, "    -s           path to splash image to display\n");
+	fprintf(stderr, "                 (both can also be compiled with pbsplash-compile)\n");
 	fprintf(stderr, "    -m           message to show under the splash image\n");
 	fprintf(stderr, "    -b           message to show at the bottom\n");
 	fprintf(stderr, "    -o           font size bottom in pt (default: %d)\n", FONT_SIZE_B_PT);
@@ -64,6 +62,11 @@ static int usage()
 	fprintf(stderr, "    -q           max logo size in mm (default: %d)\n", LOGO_SIZE_MAX_MM);
 	fprintf(stderr, "    -d           custom DPI (for testing)\n");
 	fprintf(stderr, "    -e           error (no loading animation)\n");
+	fprintf(stderr, "    -H           render headless into memory, with the given resolution,\n");
+	fprintf(stderr, "                 physical size and pixel format (default: XRGB8888)\n");
+	fprintf(stderr, "    -O           dump the final frame to a PPM (or .pam) file\n");
+	fprintf(stderr, "    -k           also log boot timings to the kernel log\n");
+	fprintf(stderr, "    -a           rasterize with exact (analytic) coverage\n");
 	// clang-format on
 
 	return 1;
@@ -74,170 +77,38 @@ static void term(int signum)
 	terminate = 1;
 }
 
-static void blit_buf(unsigned char *buf, int x, int y, int w, int h, bool vflip,
-		     bool redraw)
-{
-	struct col prev_col = { .r = 0, .g = 0, .b = 0, .a = 0 };
-	unsigned int col = tfb_make_color(
-		background_color.r, background_color.g, background_color.b);
-
-	for (size_t i = 0; i < w; i++) {
-		for (size_t j = 0; j < h; j++) {
-#if DEBUGRENDER == 1
-			if (i == 0 || i == w - 1 || j == 0 || j == h - 1) {
-				tfb_draw_pixel(x + i, y + h - j, tfb_red);
-				continue;
-			}
-#endif
-			struct col rgba =
-				*(struct col *)(buf + (j * w + i) * 4);
-			if (rgba.a == 0 || rgba.rgba == background_color.rgba)
-				continue;
-
-			// Alpha blending
-			if (rgba.a != 255) {
-				rgba.r =
-					(rgba.r * rgba.a +
-					 background_color.r * (255 - rgba.a)) >>
-					8;
-				rgba.g =
-					(rgba.g * rgba.a +
-					 background_color.g * (255 - rgba.a)) >>
-					8;
-				rgba.b =
-					(rgba.b * rgba.a +
-					 background_color.b * (255 - rgba.a)) >>
-					8;
-			}
-
-			// No need to generate the colour again if it's the same as the previous one
-			if (rgba.rgba != prev_col.rgba) {
-				prev_col.rgba = rgba.rgba;
-				col = tfb_make_color(rgba.r, rgba.g, rgba.b);
-			}
-			if (vflip)
-				tfb_draw_pixel(x + i, y + h - j, col);
-			else
-				tfb_draw_pixel(x + i, y + j, col);
-		}
-	}
-}
-
 static void draw_svg(NSVGimage *image, int x, int y, int w, int h)
 {
 	float sz = (int)((float)w / (float)image->width * 100.f) / 100.f;
 	LOG("draw_svg: (%d, %d), %dx%d, %f\n", x, y, w, h, sz);
 	NSVGrasterizer *rast = nsvgCreateRasterizer();
 	unsigned char *img = zalloc(w * h * 4);
+	nsvgRasterizerSetFlags(rast, rast_flags);
+	timing_begin(TIMING_LOGO_RASTER);
 	nsvgRasterize(rast, image, 0, 0, sz, img, w, h, w * 4);
+	timing_end(TIMING_LOGO_RASTER);
 
-	blit_buf(img, x, y, w, h, false, false);
+	timing_begin(TIMING_LOGO_BLIT);
+	fb_blit(img, x, y, w, h, false, background_color);
+	timing_end(TIMING_LOGO_BLIT);
 
 	free(img);
 	nsvgDeleteRasterizer(rast);
 }
 
-static void draw_text(const NSVGimage *font, const char *text, int x, int y, int width,
-		      int height, float scale, unsigned int tfb_col)
+static void draw_text(NSVGrasterizer *rast, const NSVGimage *font, const char *text,
+		      int x, int y, int width, int height, float scale, struct col color)
 {
 	LOG("text '%s': fontsz=%f, x=%d, y=%d, dimensions: %d x %d\n", text,
 	    scale, x, y, width, height);
-	NSVGshape **shapes = nsvgGetTextShapes(font, text, strlen(text));
-	unsigned char *img = zalloc(width * height * 4);
-	NSVGrasterizer *rast = nsvgCreateRasterizer();
+	unsigned char *mask = zalloc(width * height);
 
-	nsvgRasterizeText(rast, font, 0, 0, scale, img, width, height,
-			  width * 4, text);
+	nsvgRasterizeTextMask(rast, font, 0, 0, scale, mask, width, height,
+			      width, text);
 
-	blit_buf(img, x, y, width, height, true, false);
+	fb_blit_mask(mask, x, y, width, height, true, color, background_color);
 
-	free(img);
-	free(shapes);
-	nsvgDeleteRasterizer(rast);
-}
-
-static inline float getShapeWidth(const NSVGimage *font, const NSVGshape *shape)
-{
-	if (shape) {
-		return shape->horizAdvX;
-	} else {
-		return font->defaultHorizAdv;
-	}
-}
-
-/*
- * Get the dimensions of a string in pixels.
- * based on the font size and the font SVG file.
- */
-static const char *getTextDimensions(const NSVGimage *font, const char *text, float scale,
-			       int *width, int *height)
-{
-	int i, j;
-	int fontHeight = (font->fontAscent - font->fontDescent) * scale;
-	int maxWidth = 0;
-
-	if (text == NULL)
-		return text;
-
-	// Pre-allocate 3x the size to account for any word splitting
-	char *out_text = zalloc(strlen(text) * 3 + 1);
-
-	*width = 2; // font->defaultHorizAdv * scale;
-	// The height is simply the height of the font * the scale factor
-	*height = fontHeight;
-
-	NSVGshape **shapes = nsvgGetTextShapes(font, text, strlen(text));
-	bool line_has_space = false;
-	// Iterate over every glyph in the string to get the total width
-	// and handle line-splitting
-	for (i = 0, j = 0; text[i] != '\0'; i++, j++) {
-		NSVGshape *shape = shapes[i];
-		out_text[j] = text[i];
-		if (*width > screenWidth * 0.95) {
-			if (!line_has_space)
-				i--;
-			if (!line_has_space) {
-				if (i < 1) {
-					fprintf(stderr,
-					"ERROR: Text is too long to fit on screen!");
-					goto out;
-				}
-			} else {
-				int old_j = j;
-				while (out_text[j] != ' ' && j > 0) {
-					j--;
-				}
-				i = i - (old_j - j);
-				if (i <= 0) {
-					line_has_space = false;
-					fprintf(stderr,
-					"ERROR: Text is too long to fit on screen!");
-					goto out;
-				}
-			}
-			out_text[j] = '\n';
-		}
-
-		if (out_text[j] == '\n') {
-			printf("LINE SPLIT, %d %s\n", i, out_text);
-			line_has_space = false;
-			*height += fontHeight;
-			maxWidth = *width > maxWidth ? *width : maxWidth;
-			*width = 0;
-			continue;
-		} else if (text[i] == ' ') {
-			printf("SPACE! %s\n", out_text);
-			line_has_space = true;
-		}
-
-		*width += round(getShapeWidth(font, shape) * scale);
-	}
-
-	*width = *width > maxWidth ? *width : maxWidth;
-
-out:
-	free(shapes);
-	return out_text;
+	free(mask);
 }
 
 struct dpi_info {
@@ -249,8 +120,8 @@ struct dpi_info {
 
 static void calculate_dpi_info(struct dpi_info *dpi_info)
 {
-	int w_mm = tfb_screen_width_mm();
-	int h_mm = tfb_screen_height_mm();
+	int w_mm = fb_width_mm();
+	int h_mm = fb_height_mm();
 
 	if ((w_mm < 1 || h_mm < 1) && !dpi_info->dpi) {
 		fprintf(stderr, "ERROR!!!: Invalid screen size: %dx%d\n", w_mm, h_mm);
@@ -309,7 +180,7 @@ static void load_message(struct msg_info *msg_info, const struct dpi_info *dpi_i
 	msg_info->fontsz = (font_size_pt * PT_TO_MM) /
 			(font->fontAscent - font->fontDescent) *
 			dpi_info->pixels_per_milli;
-	msg_info->message = getTextDimensions(font, msg_info->src_message, msg_info->fontsz, &msg_info->width, &msg_info->height);
+	msg_info->message = getTextDimensions(font, msg_info->src_message, msg_info->fontsz, screenWidth * 0.95, &msg_info->width, &msg_info->height);
 	msg_info->x = (screenWidth - msg_info->width) / 2;
 	// Y coordinate is set later
 }
@@ -325,16 +196,33 @@ static void free_message(struct msg_info *msg_info)
 struct messages {
 	const char *font_path;
 	NSVGimage *font;
+	/* Kept around so glyphs are only rasterized once */
+	NSVGrasterizer *rast;
 	int font_size_pt;
 	int font_size_b_pt;
 	struct msg_info *msg;
 	struct msg_info *bottom_msg;
 };
 
-static inline void show_message(const struct msg_info *msg_info, const NSVGimage *font)
+static inline void show_message(const struct msg_info *msg_info, const struct messages *msgs)
+{
+	draw_text(msgs->rast, msgs->font, msg_info->message, msg_info->x, msg_info->y, msg_info->width,
+				msg_info->height, msg_info->fontsz, text_color);
+}
+
+/*
+ * All the characters the messages use, so only their glyphs have to be
+ * parsed out of the font.
+ */
+static char *message_chars(const struct messages *msgs)
 {
-	draw_text(font, msg_info->message, msg_info->x, msg_info->y, msg_info->width,
-				msg_info->height, msg_info->fontsz, tfb_gray);
+	const char *top = msgs->msg ? msgs->msg->src_message : "";
+	const char *bottom = msgs->bottom_msg ? msgs->bottom_msg->src_message : "";
+	char *chars = zalloc(strlen(top) + strlen(bottom) + 1);
+
+	strcat(chars, top);
+	strcat(chars, bottom);
+	return chars;
 }
 
 static void show_messages(struct messages *msgs, const struct dpi_info *dpi_info)
@@ -343,8 +231,14 @@ static void show_messages(struct messages *msgs, const struct dpi_info *dpi_info
 	if (font_failed)
 		return;
 
-	if (!msgs->font)
-		msgs->font = nsvgParseFromFile(msgs->font_path, "px", 512);
+	if (!msgs->font) {
+		char *chars = message_chars(msgs);
+
+		timing_begin(TIMING_FONT_PARSE);
+		msgs->font = svgbin_load(msgs->font_path, "px", 512, chars);
+		timing_end(TIMING_FONT_PARSE);
+		free(chars);
+	}
 	if (!msgs->font || !msgs->font->shapes) {
 		font_failed = true;
 		fprintf(stderr, "failed to load SVG font, can't render messages\n");
@@ -353,23 +247,38 @@ static void show_messages(struct messages *msgs, const struct dpi_info *dpi_info
 		return;
 	}
 
+	if (!msgs->rast) {
+		msgs->rast = nsvgCreateRasterizer();
+		if (!msgs->rast)
+			return;
+		nsvgRasterizerSetFlags(msgs->rast, NSVG_RAST_TEXT_GLYPH_CACHE | rast_flags);
+	}
+
 	if (msgs->bottom_msg) {
 		if (!msgs->bottom_msg->message) {
+			timing_begin(TIMING_MSG_LAYOUT);
 			load_message(msgs->bottom_msg, dpi_info, msgs->font_size_b_pt, msgs->font);
+			timing_end(TIMING_MSG_LAYOUT);
 			msgs->bottom_msg->y = screenHeight - msgs->bottom_msg->height - MM_TO_PX(dpi_info->dpi, B_MESSAGE_OFFSET_MM);
 		}
-		show_message(msgs->bottom_msg, msgs->font);
+		timing_begin(TIMING_MSG_RENDER);
+		show_message(msgs->bottom_msg, msgs);
+		timing_end(TIMING_MSG_RENDER);
 	}
 
 	if (msgs->msg) {
 		if (!msgs->msg->message) {
+			timing_begin(TIMING_MSG_LAYOUT);
 			load_message(msgs->msg, dpi_info, msgs->font_size_pt, msgs->font);
+			timing_end(TIMING_MSG_LAYOUT);
 			if (msgs->bottom_msg)
 				msgs->msg->y = msgs->bottom_msg->y - msgs->msg->height - (MM_TO_PX(dpi_info->dpi, msgs->font_size_b_pt * PT_TO_MM) * 0.6);
 			else
 				msgs->msg->y = screenHeight - msgs->msg->height - (MM_TO_PX(dpi_info->dpi, msgs->font_size_pt * PT_TO_MM) * 2);
 		}
-		show_message(msgs->msg, msgs->font);
+		timing_begin(TIMING_MSG_RENDER);
+		show_message(msgs->msg, msgs);
+		timing_end(TIMING_MSG_RENDER);
 	}
 }
 
@@ -386,7 +295,9 @@ static int load_image(const struct dpi_info *dpi_info, struct image_info *image_
 {
 	int logo_size_px = dpi_info->logo_size_px;
 
-	image_info->image = nsvgParseFromFile(image_info->path, "", logo_size_px);
+	timing_begin(TIMING_LOGO_PARSE);
+	image_info->image = svgbin_load(image_info->path, "", logo_size_px, NULL);
+	timing_end(TIMING_LOGO_PARSE);
 	if (!image_info->image) {
 		fprintf(stderr, "failed to load SVG image\n");
 		fprintf(stderr, "  image path: %s\n", image_info->path);
@@ -443,8 +354,16 @@ int main(int argc, char **argv)
 		.x = 0,
 		.y = 0,
 	};
+	struct fb_headless_config headless;
+	const char *headless_spec = NULL;
+	const char *dump_path = NULL;
 	int optflag;
 	bool animation = true;
+	bool timing_kmsg = false;
+	int tty = -1;
+
+	timing_init();
+	timing_begin(TIMING_ARGS);
 
 	memset(active_tty, '\0', TTY_PATH_LEN);
 	strcat(active_tty, "/dev/");
@@ -454,7 +373,7 @@ int main(int argc, char **argv)
 	sigaction(SIGTERM, &action, NULL);
 	sigaction(SIGINT, &action, NULL);
 
-	while ((optflag = getopt(argc, argv, "hvf:s:m:b:o:p:q:d:e")) != -1) {
+	while ((optflag = getopt(argc, argv, "hvf:s:m:b:o:p:q:d:eH:O:ka")) != -1) {
 		char *end = NULL;
 		switch (optflag) {
 		case 'h':
@@ -510,6 +429,23 @@ int main(int argc, char **argv)
 		case 'e':
 			animation = false;
 			break;
+		case 'H':
+			headless_spec = optarg;
+			if (fb_parse_headless_spec(headless_spec, &headless)) {
+				fprintf(stderr, "Invalid headless spec: %s\n",
+					optarg);
+				return usage();
+			}
+			break;
+		case 'O':
+			dump_path = optarg;
+			break;
+		case 'k':
+			timing_kmsg = true;
+			break;
+		case 'a':
+			rast_flags |= NSVG_RAST_ANALYTIC;
+			break;
 		default:
 			return usage();
 		}
@@ -527,19 +463,30 @@ int main(int argc, char **argv)
 	}
 
 	LOG("active tty: '%s'\n", active_tty);
+	timing_end(TIMING_ARGS);
+
+	timing_begin(TIMING_FB_ACQUIRE);
 
-	if ((rc = tfb_acquire_fb(/*TFB_FL_NO_TTY_KD_GRAPHICS */ 0, "/dev/fb0",
-				 active_tty)) != TFB_SUCCESS) {
+	if (headless_spec) {
+		if ((rc = fb_acquire_headless(&headless))) {
+			fprintf(stderr, "Failed to create headless framebuffer: %s\n",
+				strerror(-rc));
+			return 1;
+		}
+	} else if ((rc = fb_acquire("/dev/fb0", active_tty))) {
 		fprintf(stderr, "tfb_acquire_fb() failed with error code: %d\n",
 			rc);
 		rc = 1;
 		return rc;
 	}
 
-	screenWidth = (int)tfb_screen_width();
-	screenHeight = (int)tfb_screen_height();
+	screenWidth = fb_width();
+	screenHeight = fb_height();
+	timing_end(TIMING_FB_ACQUIRE);
 
+	timing_begin(TIMING_DPI_INFO);
 	calculate_dpi_info(&dpi_info);
+	timing_end(TIMING_DPI_INFO);
 
 	rc = load_image(&dpi_info, &image_info);
 	if (rc)
@@ -547,8 +494,7 @@ int main(int argc, char **argv)
 
 	float animation_y = image_info.y + image_info.height + MM_TO_PX(dpi_info.dpi, 5);
 
-	tfb_clear_screen(tfb_make_color(background_color.r, background_color.g,
-					background_color.b));
+	fb_clear(background_color);
 
 	draw_svg(image_info.image, image_info.x, image_info.y, image_info.width, image_info.height);
 
@@ -571,11 +517,20 @@ int main(int argc, char **argv)
 	show_messages(&msgs, &dpi_info);
 
 no_messages:
-	tfb_flush_window();
-	tfb_flush_fb();
+	timing_begin(TIMING_FIRST_FLUSH);
+	fb_flush();
+	timing_end(TIMING_FIRST_FLUSH);
+	timing_report(timing_kmsg);
+
+	// Headless there is nobody to watch the animation, draw one frame and exit
+	if (fb_is_headless()) {
+		if (animation)
+			animate_frame(0, screenWidth, animation_y, dpi_info.dpi);
+		goto out;
+	}
 
 	int tick = 0;
-	int tty = open(active_tty, O_RDWR);
+	tty = open(active_tty, O_RDWR);
 	if (!tty) {
 		fprintf(stderr, "Failed to open tty %s (%d)\n", active_tty, errno);
 		goto out;
@@ -593,7 +548,7 @@ no_messages:
 		clock_gettime(CLOCK_REALTIME, &start);
 		tick = timespec_to_double(timespec_sub(start, epoch)) * tickrate;
 		animate_frame(tick, screenWidth, animation_y, dpi_info.dpi);
-		tfb_flush_fb();
+		fb_flush();
 		clock_gettime(CLOCK_REALTIME, &end);
 		diff = timespec_sub(end, start);
 		//printf("%05d: %09ld\n", tick, diff.tv_nsec);
@@ -609,7 +564,8 @@ no_messages:
 out:
 	// Before we exit print the logo so it will persist
 	if (image_info.image) {
-		ioctl(tty, KDSETMODE, KD_TEXT);
+		if (tty >= 0)
+			ioctl(tty, KDSETMODE, KD_TEXT);
 		draw_svg(image_info.image, image_info.x, image_info.y, image_info.width, image_info.height);
 	}
 
@@ -617,6 +573,7 @@ out:
 	show_messages(&msgs, &dpi_info);
 
 	nsvgDelete(image_info.image);
+	nsvgDeleteRasterizer(msgs.rast);
 	nsvgDelete(msgs.font);
 	free_message(msgs.msg);
 	free_message(msgs.bottom_msg);
@@ -624,8 +581,10 @@ out:
 		free(message);
 	if (message_bottom)
 		free(message_bottom);
+	if (dump_path && fb_dump(dump_path))
+		fprintf(stderr, "Failed to dump framebuffer to %s\n", dump_path);
 	// The TTY might end up in a weird state if this
 	// is not called!
-	tfb_release_fb();
+	fb_release();
 	return rc;
 }
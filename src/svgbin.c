@@ -0,0 +1,462 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "svgbin.h"
+
+/* Every object in a compiled image starts at a multiple of this */
+#define SVGBIN_ALIGN 8
+#define SVGBIN_BYTE_ORDER 0x01020304u
+
+static void svgbin_fill_header(struct svgbin_header *hdr, uint64_t size)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, SVGBIN_MAGIC, sizeof(hdr->magic));
+	hdr->version = SVGBIN_VERSION;
+	hdr->byte_order = SVGBIN_BYTE_ORDER;
+	hdr->pointer_size = sizeof(void *);
+	hdr->image_size = sizeof(NSVGimage);
+	hdr->shape_size = sizeof(NSVGshape);
+	hdr->path_size = sizeof(NSVGpath);
+	hdr->gradient_size = sizeof(NSVGgradient);
+	hdr->size = size;
+}
+
+/*
+ * Writing
+ */
+
+struct out {
+	unsigned char *data;
+	size_t len;
+	size_t cap;
+	bool failed;
+};
+
+/* Append size bytes of src (zeroes if NULL), returns their offset */
+static size_t put(struct out *out, const void *src, size_t size)
+{
+	size_t off = (out->len + SVGBIN_ALIGN - 1) & ~(size_t)(SVGBIN_ALIGN - 1);
+
+	if (out->failed)
+		return 0;
+	if (off + size > out->cap) {
+		size_t cap = out->cap ? out->cap : 4096;
+		unsigned char *data;
+
+		while (cap < off + size)
+			cap *= 2;
+		data = realloc(out->data, cap);
+		if (!data) {
+			out->failed = true;
+			return 0;
+		}
+		out->data = data;
+		out->cap = cap;
+	}
+
+	memset(out->data + out->len, 0, off - out->len);
+	if (src)
+		memcpy(out->data + off, src, size);
+	else
+		memset(out->data + off, 0, size);
+	out->len = off + size;
+	return off;
+}
+
+/* Store the offset off in the pointer at byte pos, offsets survive realloc */
+static void set_ptr(struct out *out, size_t pos, size_t off)
+{
+	uintptr_t val = off;
+
+	if (!out->failed)
+		memcpy(out->data + pos, &val, sizeof(val));
+}
+
+struct shape_off {
+	const NSVGshape *shape;
+	size_t off;
+};
+
+static int cmp_shape_off(const void *a, const void *b)
+{
+	const NSVGshape *sa = ((const struct shape_off *)a)->shape;
+	const NSVGshape *sb = ((const struct shape_off *)b)->shape;
+
+	return (sa > sb) - (sa < sb);
+}
+
+/* Offset of shape, 0 for NULL. -1 if shape isn't in the image */
+static size_t shape_offset(const struct shape_off *offs, int count,
+			   const NSVGshape *shape)
+{
+	struct shape_off key = { .shape = shape };
+	const struct shape_off *found;
+
+	if (!shape)
+		return 0;
+	found = bsearch(&key, offs, count, sizeof(*offs), cmp_shape_off);
+	return found ? found->off : (size_t)-1;
+}
+
+/* Copy the gradient of the paint stored at byte pos, if it has one */
+static void put_paint(struct out *out, size_t pos, const NSVGpaint *paint)
+{
+	const NSVGgradient *grad = paint->gradient;
+
+	if (paint->type != NSVG_PAINT_LINEAR_GRADIENT &&
+	    paint->type != NSVG_PAINT_RADIAL_GRADIENT)
+		return;
+	set_ptr(out, pos + offsetof(NSVGpaint, gradient),
+		put(out, grad, sizeof(*grad) +
+		    (grad->nstops - 1) * sizeof(NSVGgradientStop)));
+}
+
+static int put_image(struct out *out, const NSVGimage *image)
+{
+	struct svgbin_header hdr;
+	struct shape_off *offs;
+	const NSVGshape *shape;
+	size_t image_off, off, prev;
+	int count = 0, i;
+
+	svgbin_fill_header(&hdr, 0);
+	put(out, &hdr, sizeof(hdr));
+	image_off = put(out, image, sizeof(*image));
+	off = image_off + offsetof(NSVGimage, arena);
+	set_ptr(out, off, 0);
+
+	for (shape = image->shapes; shape; shape = shape->next)
+		count++;
+	offs = calloc(count ? count : 1, sizeof(*offs));
+	if (!offs)
+		return -ENOMEM;
+
+	/*
+	 * Shapes go first and back to back, so the loader can check that
+	 * glyph pointers point at one cheaply.
+	 */
+	prev = image_off + offsetof(NSVGimage, shapes);
+	for (shape = image->shapes, i = 0; shape; shape = shape->next, i++) {
+		offs[i].shape = shape;
+		offs[i].off = put(out, shape, sizeof(*shape));
+		set_ptr(out, prev, offs[i].off);
+		prev = offs[i].off + offsetof(NSVGshape, next);
+	}
+	set_ptr(out, prev, 0);
+	qsort(offs, count, sizeof(*offs), cmp_shape_off);
+
+	for (shape = image->shapes; shape; shape = shape->next) {
+		size_t shape_off = shape_offset(offs, count, shape);
+		const NSVGpath *path;
+
+		off = shape_offset(offs, count, shape->nextGlyph);
+		if (off == (size_t)-1)
+			goto err_inval;
+		set_ptr(out, shape_off + offsetof(NSVGshape, nextGlyph), off);
+
+		put_paint(out, shape_off + offsetof(NSVGshape, fill), &shape->fill);
+		put_paint(out, shape_off + offsetof(NSVGshape, stroke), &shape->stroke);
+
+		prev = shape_off + offsetof(NSVGshape, paths);
+		for (path = shape->paths; path; path = path->next) {
+			size_t path_off = put(out, path, sizeof(*path));
+
+			set_ptr(out, prev, path_off);
+			set_ptr(out, path_off + offsetof(NSVGpath, pts),
+				put(out, path->pts, path->npts * 2 * sizeof(float)));
+			prev = path_off + offsetof(NSVGpath, next);
+		}
+		set_ptr(out, prev, 0);
+	}
+
+	for (i = 0; i < 256; i++) {
+		off = shape_offset(offs, count, image->latin1Glyphs[i]);
+		if (off == (size_t)-1)
+			goto err_inval;
+		set_ptr(out, image_off + offsetof(NSVGimage, latin1Glyphs[i]), off);
+	}
+
+	off = 0;
+	if (image->glyphHash) {
+		off = put(out, image->glyphHash,
+			  image->glyphHashSize * sizeof(NSVGglyphEntry));
+		for (i = 0; i < image->glyphHashSize; i++) {
+			size_t entry = off + i * sizeof(NSVGglyphEntry) +
+				       offsetof(NSVGglyphEntry, shape);
+			size_t shape_off = shape_offset(offs, count,
+							image->glyphHash[i].shape);
+
+			if (shape_off == (size_t)-1)
+				goto err_inval;
+			set_ptr(out, entry, shape_off);
+		}
+	}
+	set_ptr(out, image_off + offsetof(NSVGimage, glyphHash), off);
+
+	free(offs);
+	if (out->failed)
+		return -ENOMEM;
+	svgbin_fill_header(&hdr, out->len);
+	memcpy(out->data, &hdr, sizeof(hdr));
+	return 0;
+
+err_inval:
+	free(offs);
+	return -EINVAL;
+}
+
+int svgbin_write(const NSVGimage *image, const char *path)
+{
+	struct out out = { 0 };
+	size_t done = 0;
+	int fd, ret;
+
+	ret = put_image(&out, image);
+	if (ret < 0)
+		goto out;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		ret = -errno;
+		goto out;
+	}
+	while (done < out.len) {
+		ssize_t n = write(fd, out.data + done, out.len - done);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+		done += n;
+	}
+	if (close(fd) < 0 && ret == 0)
+		ret = -errno;
+
+out:
+	free(out.data);
+	return ret;
+}
+
+/*
+ * Loading
+ */
+
+struct fixup {
+	unsigned char *base;
+	size_t size;
+	bool ok;
+};
+
+/* Turn the offset stored in *ptr back into a pointer to size bytes */
+static void *rebase(struct fixup *fix, void *ptr, size_t size)
+{
+	uintptr_t off = (uintptr_t)ptr;
+
+	if (off == 0)
+		return NULL;
+	if (off < sizeof(struct svgbin_header) || off % SVGBIN_ALIGN ||
+	    off > fix->size || size > fix->size - off) {
+		fix->ok = false;
+		return NULL;
+	}
+	return fix->base + off;
+}
+
+/* Shapes are back to back from first up to end, see put_image() */
+static NSVGshape *rebase_shape(struct fixup *fix, NSVGshape *shape,
+			       uintptr_t first, uintptr_t end)
+{
+	uintptr_t off = (uintptr_t)shape;
+
+	if (off == 0)
+		return NULL;
+	if (off < first || off >= end || (off - first) % sizeof(NSVGshape)) {
+		fix->ok = false;
+		return NULL;
+	}
+	return (NSVGshape *)(fix->base + off);
+}
+
+static void fixup_paint(struct fixup *fix, NSVGpaint *paint)
+{
+	NSVGgradient *grad;
+
+	if (paint->type != NSVG_PAINT_LINEAR_GRADIENT &&
+	    paint->type != NSVG_PAINT_RADIAL_GRADIENT)
+		return;
+	grad = rebase(fix, paint->gradient, sizeof(*grad));
+	if (!grad || grad->nstops < 1 ||
+	    (size_t)grad->nstops > fix->size / sizeof(NSVGgradientStop) ||
+	    !rebase(fix, paint->gradient, sizeof(*grad) +
+		    (grad->nstops - 1) * sizeof(NSVGgradientStop))) {
+		fix->ok = false;
+		return;
+	}
+	paint->gradient = grad;
+}
+
+/* The file is the data of block, which becomes the image's arena */
+static bool fixup_image(NSVGarenaBlock *block)
+{
+	unsigned char *base = (unsigned char *)(block + 1);
+	size_t size = block->size;
+	struct fixup fix = { .base = base, .size = size, .ok = true };
+	NSVGimage *image = (NSVGimage *)(base + sizeof(struct svgbin_header));
+	uintptr_t first = (uintptr_t)image->shapes, end = first;
+	NSVGshape *shape, **link;
+	NSVGpath *path, **plink;
+	int i;
+
+	image->arena = block;
+
+	/* Find the end of the shapes first, so glyph pointers can be checked */
+	for (link = &image->shapes; *link; link = &shape->next) {
+		shape = rebase(&fix, *link, sizeof(*shape));
+		if (!shape || (uintptr_t)*link != end) {
+			fix.ok = false;
+			break;
+		}
+		*link = shape;
+		end += sizeof(*shape);
+	}
+
+	for (shape = image->shapes; fix.ok && shape; shape = shape->next) {
+		/* Both are read as C strings, so must end inside the shape */
+		if (!memchr(shape->id, '\0', sizeof(shape->id)) ||
+		    !memchr(shape->unicode, '\0', sizeof(shape->unicode))) {
+			fix.ok = false;
+			break;
+		}
+		shape->nextGlyph = rebase_shape(&fix, shape->nextGlyph, first, end);
+		fixup_paint(&fix, &shape->fill);
+		fixup_paint(&fix, &shape->stroke);
+
+		for (plink = &shape->paths; fix.ok && *plink; plink = &path->next) {
+			path = rebase(&fix, *plink, sizeof(*path));
+			if (!path || path->npts < 0 ||
+			    (size_t)path->npts > size / (2 * sizeof(float))) {
+				fix.ok = false;
+				break;
+			}
+			path->pts = rebase(&fix, path->pts,
+					   path->npts * 2 * sizeof(float));
+			*plink = path;
+		}
+	}
+
+	for (i = 0; fix.ok && i < 256; i++)
+		image->latin1Glyphs[i] = rebase_shape(&fix, image->latin1Glyphs[i],
+						      first, end);
+
+	/*
+	 * Lookups mask the hash with glyphHashSize - 1 and probe until they
+	 * find the codepoint or an empty slot, see nsvg__glyphSlot()
+	 */
+	if (fix.ok && image->glyphHash) {
+		NSVGglyphEntry *entry;
+		int empty = 0;
+
+		if (image->glyphHashSize < 1 ||
+		    (image->glyphHashSize & (image->glyphHashSize - 1)) ||
+		    (size_t)image->glyphHashSize > size / sizeof(NSVGglyphEntry))
+			return false;
+		image->glyphHash = rebase(&fix, image->glyphHash,
+					  image->glyphHashSize * sizeof(NSVGglyphEntry));
+		for (i = 0; fix.ok && i < image->glyphHashSize; i++) {
+			entry = &image->glyphHash[i];
+			if (!entry->shape) {
+				empty++;
+				continue;
+			}
+			entry->shape = rebase_shape(&fix, entry->shape, first, end);
+			if (!entry->shape)
+				fix.ok = false;
+		}
+		if (!empty)
+			fix.ok = false;
+	} else if (image->glyphHashSize != 0) {
+		fix.ok = false;
+	}
+
+	return fix.ok;
+}
+
+static bool is_compiled(const struct svgbin_header *hdr, size_t size)
+{
+	struct svgbin_header expect;
+
+	if (size < sizeof(*hdr) + sizeof(NSVGimage))
+		return false;
+	svgbin_fill_header(&expect, size);
+	return memcmp(hdr, &expect, sizeof(*hdr)) == 0;
+}
+
+/* Read the compiled image in fd after its header hdr, NULL on failure */
+static NSVGimage *load_compiled(int fd, const struct svgbin_header *hdr)
+{
+	NSVGarenaBlock *block;
+	unsigned char *data;
+	size_t done = sizeof(*hdr);
+
+	block = malloc(sizeof(*block) + hdr->size);
+	if (!block)
+		return NULL;
+	block->next = NULL;
+	block->size = block->used = hdr->size;
+	data = (unsigned char *)(block + 1);
+	memcpy(data, hdr, sizeof(*hdr));
+	while (done < hdr->size) {
+		ssize_t n = read(fd, data + done, hdr->size - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			goto err;
+		done += n;
+	}
+
+	if (!fixup_image(block))
+		goto err;
+	return (NSVGimage *)(data + sizeof(*hdr));
+
+err:
+	free(block);
+	return NULL;
+}
+
+NSVGimage *svgbin_load(const char *path, const char *units, float dpi,
+		       const char *chars)
+{
+	struct svgbin_header hdr;
+	NSVGimage *image;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+	    read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+	    is_compiled(&hdr, st.st_size)) {
+		image = load_compiled(fd, &hdr);
+		close(fd);
+		return image;
+	}
+	close(fd);
+
+	/*
+	 * Not compiled, leave it to nanosvg. Fonts can be large and only a few
+	 * of their glyphs are kept, so read them a chunk at a time rather
+	 * than holding the whole file in memory.
+	 */
+	if (chars)
+		return nsvgParseFontFromFileChunked(path, units, dpi, chars, 0);
+	return nsvgParseFromFile(path, units, dpi);
+}
@@ -0,0 +1,101 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanosvg.h"
+#include "pbsplash.h"
+#include "text.h"
+
+#define zalloc(size) calloc(1, size)
+
+static inline float getShapeWidth(const NSVGimage *font, const NSVGshape *shape)
+{
+	if (shape) {
+		return shape->horizAdvX;
+	} else {
+		return font->defaultHorizAdv;
+	}
+}
+
+/*
+ * Get the dimensions of a string in pixels.
+ * based on the font size and the font SVG file.
+ */
+const char *getTextDimensions(const NSVGimage *font, const char *text, float scale,
+			      int max_width, int *width, int *height)
+{
+	int i, j;
+	int fontHeight = (font->fontAscent - font->fontDescent) * scale;
+	int maxWidth = 0;
+
+	if (text == NULL)
+		return text;
+
+	// Pre-allocate 3x the size to account for any word splitting
+	char *out_text = zalloc(strlen(text) * 3 + 1);
+
+	*width = 2; // font->defaultHorizAdv * scale;
+	// The height is simply the height of the font * the scale factor
+	*height = fontHeight;
+
+	int len = strlen(text);
+	int n, m, prev = 0;
+	bool line_has_space = false;
+	// Iterate over every glyph in the string to get the total width
+	// and handle line-splitting. i and j advance by n and m bytes, one
+	// character (or ligature) at a time.
+	for (i = 0, j = 0; text[i] != '\0'; prev = i, i += n, j += m) {
+		NSVGshape *shape = NULL;
+		n = 1;
+		if (text[i] != ' ' && text[i] != '\n')
+			shape = nsvgGetTextGlyph(font, &text[i], len - i, &n);
+		m = n;
+		memcpy(&out_text[j], &text[i], n);
+		if (*width > max_width) {
+			if (!line_has_space) {
+				if (prev < 1) {
+					fprintf(stderr,
+					"ERROR: Text is too long to fit on screen!");
+					goto out;
+				}
+				// Break before this character, it starts the next line
+				n = 0;
+			} else {
+				int old_j = j;
+				while (out_text[j] != ' ' && j > 0) {
+					j--;
+				}
+				i = i - (old_j - j);
+				if (i <= 0) {
+					line_has_space = false;
+					fprintf(stderr,
+					"ERROR: Text is too long to fit on screen!");
+					goto out;
+				}
+				// The line break replaces the space
+				n = 1;
+			}
+			out_text[j] = '\n';
+			m = 1;
+		}
+
+		if (out_text[j] == '\n') {
+			LOG("LINE SPLIT, %d %s\n", i, out_text);
+			line_has_space = false;
+			*height += fontHeight;
+			maxWidth = *width > maxWidth ? *width : maxWidth;
+			*width = 0;
+			continue;
+		} else if (text[i] == ' ') {
+			LOG("SPACE! %s\n", out_text);
+			line_has_space = true;
+		}
+
+		*width += round(getShapeWidth(font, shape) * scale);
+	}
+
+	*width = *width > maxWidth ? *width : maxWidth;
+
+out:
+	return out_text;
+}
@@ -0,0 +1,90 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "timespec.h"
+#include "timing.h"
+
+static const char *phase_names[TIMING_PHASE_COUNT] = {
+	[TIMING_ARGS] = "args",
+	[TIMING_FB_ACQUIRE] = "fb_acquire",
+	[TIMING_DPI_INFO] = "dpi_info",
+	[TIMING_LOGO_PARSE] = "logo_parse",
+	[TIMING_LOGO_RASTER] = "logo_raster",
+	[TIMING_LOGO_BLIT] = "logo_blit",
+	[TIMING_FONT_PARSE] = "font_parse",
+	[TIMING_MSG_LAYOUT] = "msg_layout",
+	[TIMING_MSG_RENDER] = "msg_render",
+	[TIMING_FIRST_FLUSH] = "first_flush",
+};
+
+static struct {
+	bool done;
+	struct timespec init;
+	struct timespec end;
+	struct timespec begin[TIMING_PHASE_COUNT];
+	struct timespec total[TIMING_PHASE_COUNT];
+} timing;
+
+static long to_us(struct timespec ts)
+{
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+void timing_init(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &timing.init);
+}
+
+void timing_begin(enum timing_phase phase)
+{
+	if (!timing.done)
+		clock_gettime(CLOCK_MONOTONIC, &timing.begin[phase]);
+}
+
+void timing_end(enum timing_phase phase)
+{
+	if (timing.done)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &timing.end);
+	timing.total[phase] =
+		timespec_add(timing.total[phase],
+			     timespec_sub(timing.end, timing.begin[phase]));
+}
+
+void timing_report(bool kmsg)
+{
+	char line[512], record[520];
+	int len;
+	int fd;
+
+	if (timing.done)
+		return;
+	timing.done = true;
+
+	// The start time lines up with the kernel log timestamps
+	len = snprintf(line, sizeof(line), "pbsplash: timing start_us=%ld",
+		       to_us(timing.init));
+	for (int i = 0; i < TIMING_PHASE_COUNT; i++)
+		len += snprintf(line + len, sizeof(line) - len, " %s_us=%ld",
+				phase_names[i], to_us(timing.total[i]));
+	// The last phase to end is the first flush, i.e. the first pixel
+	len += snprintf(line + len, sizeof(line) - len, " first_pixel_us=%ld\n",
+			to_us(timespec_sub(timing.end, timing.init)));
+
+	fputs(line, stderr);
+
+	if (!kmsg)
+		return;
+
+	fd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	// Log level 6 (info), /dev/kmsg expects one record per write
+	len = snprintf(record, sizeof(record), "<6>%s", line);
+	if (write(fd, record, len) < 0)
+		perror("write /dev/kmsg");
+	close(fd);
+}
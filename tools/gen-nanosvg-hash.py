@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+Generate the perfect hash tables nanosvg.h uses to look up element names,
+attribute names and colour keywords, and write them into nanosvg.h between
+the BEGIN/END GENERATED HASH TABLES markers.
+
+Names hash with 32 bit FNV-1a from a per table seed, and the top bits of
+the hash index the table. The seed is searched for so that no two names
+share a slot, so a lookup is one hash and one strcmp() against the only
+candidate. Run this again after changing the lists below or the colour
+keywords in nsvg__colors:
+
+    tools/gen-nanosvg-hash.py include/nanosvg.h
+"""
+
+import re
+import sys
+
+# Elements the parser handles, in the order of the enum
+ELEMENTS = [
+    "circle", "defs", "ellipse", "font", "font-face", "g", "glyph", "line",
+    "linearGradient", "path", "polygon", "polyline", "radialGradient", "rect",
+    "stop", "svg",
+]
+
+# Attributes and style properties the parser handles
+ATTRIBUTES = [
+    "ascent", "cx", "cy", "d", "descent", "display", "fill", "fill-opacity",
+    "fill-rule", "font-size", "fx", "fy", "gradientTransform",
+    "gradientUnits", "height", "horiz-adv-x", "id", "offset", "opacity",
+    "points", "preserveAspectRatio", "r", "rx", "ry", "spreadMethod",
+    "stop-color", "stop-opacity", "stroke", "stroke-dasharray",
+    "stroke-dashoffset", "stroke-linecap", "stroke-linejoin",
+    "stroke-miterlimit", "stroke-opacity", "stroke-width", "style",
+    "transform", "unicode", "viewBox", "width", "x", "x1", "x2",
+    "xlink:href", "y", "y1", "y2",
+]
+
+BEGIN = "// BEGIN GENERATED HASH TABLES\n"
+END = "// END GENERATED HASH TABLES\n"
+
+FNV_PRIME = 16777619
+
+
+def fnv1a(name, seed):
+    h = seed
+    for c in name.encode():
+        h = ((h ^ c) * FNV_PRIME) & 0xffffffff
+    return h
+
+
+def perfect_hash(names):
+    """Returns (seed, bits, slots) with slots[i] the index of the name in it"""
+    bits = max(1, (len(names) - 1).bit_length() + 1)
+    while True:
+        for seed in range(1, 1 << 20):
+            slots = [None] * (1 << bits)
+            for i, name in enumerate(names):
+                slot = fnv1a(name, seed) >> (32 - bits)
+                if slots[slot] is not None:
+                    break
+                slots[slot] = i
+            else:
+                return seed, bits, slots
+        bits += 1
+
+
+def enum_name(prefix, name):
+    name = re.sub(r"([a-z])([A-Z])", r"\1_\2", name)
+    return prefix + re.sub(r"[^A-Za-z0-9]", "_", name).upper()
+
+
+def table(ctype, name, seed_name, bits_name, seed, bits, values):
+    out = [
+        f"#define {seed_name} 0x{seed:08x}u\n",
+        f"#define {bits_name} {bits}\n",
+        f"static const {ctype} {name}[{len(values)}] = {{\n",
+    ]
+    for i in range(0, len(values), 16):
+        out.append("\t" + ", ".join(str(v) for v in values[i:i + 16]) + ",\n")
+    out.append("};\n")
+    return out
+
+
+def names_table(kind, prefix, names):
+    """Enum, name array and hash table, looked up by id + 1 (0 is empty)"""
+    upper = kind.upper()
+    out = [f"enum NSVG{kind}Id {{\n", f"\t{prefix}UNKNOWN = 0,\n"]
+    out += [f"\t{enum_name(prefix, n)},\n" for n in names]
+    out.append("};\n\n")
+    out.append(f"static const char* nsvg__{kind}Names[] = {{\n\t\"\",\n")
+    out += [f"\t\"{n}\",\n" for n in names]
+    out.append("};\n\n")
+    seed, bits, slots = perfect_hash(names)
+    values = [0 if s is None else s + 1 for s in slots]
+    out += table("unsigned char", f"nsvg__{kind}Hash",
+                 f"NSVG__{upper}_SEED", f"NSVG__{upper}_BITS",
+                 seed, bits, values)
+    return out
+
+
+def color_table(name, suffix, colors):
+    """Hash table of index + 1 into nsvg__colors for the first len(colors)"""
+    seed, bits, slots = perfect_hash(colors)
+    values = [0 if s is None else s + 1 for s in slots]
+    return table("unsigned char", name, f"NSVG__COLOR_SEED{suffix}",
+                 f"NSVG__COLOR_BITS{suffix}", seed, bits, values)
+
+
+def read_colors(src):
+    start = src.index("NSVGNamedColor nsvg__colors[] = {")
+    end = src.index("};", start)
+    body = src[start:end]
+    split = body.index("#ifdef NANOSVG_ALL_COLOR_KEYWORDS")
+    pattern = re.compile(r'\{\s*"([a-z]+)",\s*NSVG_RGB')
+    basic = pattern.findall(body[:split])
+    extra = pattern.findall(body[split:])
+    return basic, basic + extra
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(f"usage: {sys.argv[0]} nanosvg.h")
+    path = sys.argv[1]
+    with open(path) as f:
+        src = f.read()
+
+    basic, every = read_colors(src)
+    assert len(every) < 255, "colour indices must fit an unsigned char"
+
+    out = [BEGIN]
+    out += names_table("element", "NSVG_ELEMENT_", ELEMENTS)
+    out.append("\n")
+    out += names_table("attr", "NSVG_ATTR_", ATTRIBUTES)
+    out.append("\n#ifdef NANOSVG_ALL_COLOR_KEYWORDS\n")
+    out += color_table("nsvg__colorHash", "", every)
+    out.append("#else\n")
+    out += color_table("nsvg__colorHash", "", basic)
+    out.append("#endif\n")
+    out.append(END)
+
+    start = src.index(BEGIN)
+    end = src.index(END) + len(END)
+    with open(path, "w") as f:
+        f.write(src[:start] + "".join(out) + src[end:])
+
+
+if __name__ == "__main__":
+    main()